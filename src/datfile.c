@@ -0,0 +1,481 @@
+/*
+Tandem Repeats Finder
+Copyright (C) 1999-2020 Gary Benson
+
+This file is part of the Tandem Repeats Finder (TRF) program.
+
+TRF is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+TRF is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public
+License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "datfile.h"
+#include "outbuf.h"
+
+void OutputDatBanner(struct outbuf *out, const char *version)
+{
+    OutputString(out, "Tandem Repeats Finder Program written by:\n\n");
+    OutputString(out, "Gary Benson\n");
+    OutputString(out, "Program in Bioinformatics\n");
+    OutputString(out, "Boston University\n");
+    OutputString(out, "Version ");
+    OutputString(out, version);
+    OutputChar(out, '\n');
+}
+
+void OutputDatSequence(struct outbuf *out, const char *name, const unsigned int *parameters, int ngs)
+{
+    int i;
+
+    if (ngs) {
+        OutputChar(out, '@');
+        OutputString(out, name);
+        OutputChar(out, '\n');
+        return;
+    }
+
+    OutputString(out, "\n\nSequence: ");
+    OutputString(out, name);
+    OutputString(out, "\n\n\n\nParameters:");
+    for (i = 0; i < 7; i++) {
+        OutputChar(out, ' ');
+        OutputInt(out, (int)parameters[i]);
+    }
+    OutputString(out, "\n\n\n");
+}
+
+/* "%d %d %d %.1f %d %d %d %d %d %d %d %d %.2f %s %s", the flanks and
+ * the edit string */
+void OutputDatRecord(struct outbuf *out, const struct datrecord *record)
+{
+    OutputInt(out, record->first);
+    OutputChar(out, ' ');
+    OutputInt(out, record->last);
+    OutputChar(out, ' ');
+    OutputInt(out, record->period);
+    OutputChar(out, ' ');
+    OutputFixed(out, record->copies, 1);
+    OutputChar(out, ' ');
+    OutputInt(out, record->size);
+    OutputChar(out, ' ');
+    OutputInt(out, record->matches);
+    OutputChar(out, ' ');
+    OutputInt(out, record->indels);
+    OutputChar(out, ' ');
+    OutputInt(out, record->score);
+    OutputChar(out, ' ');
+    OutputInt(out, record->acount);
+    OutputChar(out, ' ');
+    OutputInt(out, record->ccount);
+    OutputChar(out, ' ');
+    OutputInt(out, record->gcount);
+    OutputChar(out, ' ');
+    OutputInt(out, record->tcount);
+    OutputChar(out, ' ');
+    OutputFixed(out, record->entropy, 2);
+    OutputChar(out, ' ');
+    OutputString(out, record->pattern);
+    OutputChar(out, ' ');
+    OutputSpan(out, record->sequence, record->sequencelength);
+
+    if (record->leftflank != NULL) {
+        OutputChar(out, ' ');
+        OutputSpan(out, record->leftflank, record->leftlength);
+        OutputChar(out, ' ');
+        OutputSpan(out, record->rightflank, record->rightlength);
+    }
+
+    if (record->edits != NULL) {
+        OutputChar(out, ' ');
+        OutputString(out, record->edits);
+    }
+
+    OutputChar(out, '\n');
+}
+
+void OutputBedRecord(struct outbuf *out, const char *seqid, const struct datrecord *record)
+{
+    OutputString(out, seqid);
+    OutputChar(out, '\t');
+    OutputInt(out, record->first - 1);
+    OutputChar(out, '\t');
+    OutputInt(out, record->last);
+    OutputChar(out, '\t');
+    OutputInt(out, record->period);
+    OutputChar(out, 'x');
+    OutputFixed(out, record->copies, 1);
+    OutputChar(out, '\t');
+    OutputInt(out, record->score < 1000 ? record->score : 1000);
+    OutputString(out, "\t.\t");
+    OutputInt(out, record->period);
+    OutputChar(out, '\t');
+    OutputFixed(out, record->copies, 1);
+    OutputChar(out, '\t');
+    OutputInt(out, record->size);
+    OutputChar(out, '\t');
+    OutputInt(out, record->matches);
+    OutputChar(out, '\t');
+    OutputInt(out, record->indels);
+    OutputChar(out, '\t');
+    OutputInt(out, record->score);
+    OutputChar(out, '\t');
+    OutputInt(out, record->acount);
+    OutputChar(out, '\t');
+    OutputInt(out, record->ccount);
+    OutputChar(out, '\t');
+    OutputInt(out, record->gcount);
+    OutputChar(out, '\t');
+    OutputInt(out, record->tcount);
+    OutputChar(out, '\t');
+    OutputFixed(out, record->entropy, 2);
+    OutputChar(out, '\t');
+    OutputString(out, record->pattern);
+    OutputChar(out, '\n');
+}
+
+void OutputGffHeader(struct outbuf *out)
+{
+    OutputString(out, "##gff-version 3\n");
+}
+
+void OutputGffRecord(struct outbuf *out, const char *seqid, const struct datrecord *record)
+{
+    OutputString(out, seqid);
+    OutputString(out, "\tTRF\ttandem_repeat\t");
+    OutputInt(out, record->first);
+    OutputChar(out, '\t');
+    OutputInt(out, record->last);
+    OutputChar(out, '\t');
+    OutputInt(out, record->score);
+    OutputString(out, "\t.\t.\tperiod=");
+    OutputInt(out, record->period);
+    OutputString(out, ";copies=");
+    OutputFixed(out, record->copies, 1);
+    OutputString(out, ";consensus_size=");
+    OutputInt(out, record->size);
+    OutputString(out, ";percent_matches=");
+    OutputInt(out, record->matches);
+    OutputString(out, ";percent_indels=");
+    OutputInt(out, record->indels);
+    OutputString(out, ";entropy=");
+    OutputFixed(out, record->entropy, 2);
+    OutputString(out, ";consensus=");
+    OutputString(out, record->pattern);
+    OutputChar(out, '\n');
+}
+
+/* the files a binary .dat file is collected in until it is written */
+struct datbinary {
+    FILE *fp;
+    struct datbinheader header;
+    FILE *column[DATBIN_COLUMNS];
+    FILE *sequences;
+    FILE *heap;
+    struct datbinsequence current;  /* sequence taking records */
+    int started;                /* whether current is in use */
+    int error;
+};
+
+/* Adds text[0..n-1] and a NUL to the heap. Returns its offset. */
+static uint64_t add_heap_text(struct datbinary *bin, const char *text, size_t n)
+{
+    uint64_t offset = bin->header.heapsize;
+
+    if (fwrite(text, 1, n, bin->heap) != n || putc('\0', bin->heap) == EOF)
+        bin->error = 1;
+    bin->header.heapsize += n + 1;
+    return offset;
+}
+
+static void add_int(struct datbinary *bin, int column, int value)
+{
+    int32_t v = value;
+
+    if (fwrite(&v, sizeof v, 1, bin->column[column]) != 1)
+        bin->error = 1;
+}
+
+static void add_float(struct datbinary *bin, int column, float value)
+{
+    if (fwrite(&value, sizeof value, 1, bin->column[column]) != 1)
+        bin->error = 1;
+}
+
+static void add_offset(struct datbinary *bin, int column, uint64_t value)
+{
+    if (fwrite(&value, sizeof value, 1, bin->column[column]) != 1)
+        bin->error = 1;
+}
+
+struct datbinary *CreateDatBinary(FILE *fp, const unsigned int *parameters, const char *version, int ngs,
+    int cigar)
+{
+    struct datbinary *bin;
+    int i;
+
+    bin = calloc(1, sizeof *bin);
+    if (bin == NULL)
+        return NULL;
+
+    bin->fp = fp;
+    memcpy(bin->header.magic, DATBIN_MAGIC, sizeof bin->header.magic);
+    bin->header.byteorder = DATBIN_BYTEORDER;
+    bin->header.flags = (ngs ? DATBIN_NGS : 0) | (cigar ? DATBIN_CIGAR : 0);
+    for (i = 0; i < 7; i++)
+        bin->header.parameters[i] = parameters[i];
+    bin->header.columns = DATBIN_COLUMNS;
+    strncpy(bin->header.version, version, sizeof bin->header.version - 1);
+
+    bin->sequences = tmpfile();
+    bin->heap = tmpfile();
+    for (i = 0; i < DATBIN_COLUMNS; i++)
+        bin->column[i] = tmpfile();
+
+    for (i = 0; i < DATBIN_COLUMNS; i++)
+        if (bin->column[i] == NULL)
+            bin->error = 1;
+    if (bin->sequences == NULL || bin->heap == NULL || bin->error) {
+        bin->fp = NULL;
+        FinishDatBinary(bin);
+        return NULL;
+    }
+
+    return bin;
+}
+
+/* Moves the finished sequence to the sequence table. */
+static void end_sequence(struct datbinary *bin)
+{
+    if (!bin->started)
+        return;
+
+    if (fwrite(&bin->current, sizeof bin->current, 1, bin->sequences) != 1)
+        bin->error = 1;
+    bin->header.nsequences++;
+    bin->started = 0;
+}
+
+void AddDatBinarySequence(struct datbinary *bin, const char *name)
+{
+    end_sequence(bin);
+    bin->current.name = add_heap_text(bin, name, strlen(name));
+    bin->current.firstrecord = bin->header.nrecords;
+    bin->current.records = 0;
+    bin->started = 1;
+}
+
+void AddDatBinaryRecord(struct datbinary *bin, const struct datrecord *record)
+{
+    add_int(bin, DATBIN_FIRST, record->first);
+    add_int(bin, DATBIN_LAST, record->last);
+    add_int(bin, DATBIN_PERIOD, record->period);
+    add_float(bin, DATBIN_COPIES, record->copies);
+    add_int(bin, DATBIN_SIZE, record->size);
+    add_int(bin, DATBIN_MATCHES, record->matches);
+    add_int(bin, DATBIN_INDELS, record->indels);
+    add_int(bin, DATBIN_SCORE, record->score);
+    add_int(bin, DATBIN_ACOUNT, record->acount);
+    add_int(bin, DATBIN_CCOUNT, record->ccount);
+    add_int(bin, DATBIN_GCOUNT, record->gcount);
+    add_int(bin, DATBIN_TCOUNT, record->tcount);
+    add_float(bin, DATBIN_ENTROPY, record->entropy);
+    add_offset(bin, DATBIN_PATTERN, add_heap_text(bin, record->pattern, strlen(record->pattern)));
+    add_offset(bin, DATBIN_SEQUENCE, add_heap_text(bin, record->sequence, record->sequencelength));
+
+    /* without flanks these point at the empty string ending the sequence */
+    if (record->leftflank != NULL) {
+        add_offset(bin, DATBIN_LEFTFLANK, add_heap_text(bin, record->leftflank, record->leftlength));
+        add_offset(bin, DATBIN_RIGHTFLANK, add_heap_text(bin, record->rightflank, record->rightlength));
+    }
+    else {
+        add_offset(bin, DATBIN_LEFTFLANK, bin->header.heapsize - 1);
+        add_offset(bin, DATBIN_RIGHTFLANK, bin->header.heapsize - 1);
+    }
+    if (record->edits != NULL)
+        add_offset(bin, DATBIN_EDITS, add_heap_text(bin, record->edits, strlen(record->edits)));
+    else
+        add_offset(bin, DATBIN_EDITS, bin->header.heapsize - 1);
+
+    bin->header.nrecords++;
+    bin->current.records++;
+}
+
+/* Appends the contents of tmp to the output, padded with zeros to a
+ * multiple of 8 bytes. Returns the number of bytes written. */
+static uint64_t copy_section(struct datbinary *bin, FILE *tmp)
+{
+    char buffer[65536];
+    size_t n;
+    uint64_t total = 0;
+
+    rewind(tmp);
+    while ((n = fread(buffer, 1, sizeof buffer, tmp)) > 0) {
+        if (fwrite(buffer, 1, n, bin->fp) != n)
+            bin->error = 1;
+        total += n;
+    }
+    if (ferror(tmp))
+        bin->error = 1;
+
+    memset(buffer, 0, 8);
+    n = (size_t)((8 - total % 8) % 8);
+    if (n > 0 && fwrite(buffer, 1, n, bin->fp) != n)
+        bin->error = 1;
+    return total + n;
+}
+
+int FinishDatBinary(struct datbinary *bin)
+{
+    uint64_t offset;
+    int i, status;
+
+    if (bin->fp != NULL) {
+        end_sequence(bin);
+
+        /* the header goes first, but its offsets are known in advance */
+        offset = DATBIN_HEADERSIZE;
+        for (i = 0; i < DATBIN_COLUMNS; i++) {
+            bin->header.column[i] = offset;
+            offset += (ftell(bin->column[i]) + 7) / 8 * 8;
+        }
+        bin->header.sequences = offset;
+        offset += bin->header.nsequences * sizeof(struct datbinsequence);
+        bin->header.heap = offset;
+
+        if (fwrite(&bin->header, DATBIN_HEADERSIZE, 1, bin->fp) != 1)
+            bin->error = 1;
+        for (i = 0; i < DATBIN_COLUMNS; i++)
+            copy_section(bin, bin->column[i]);
+        copy_section(bin, bin->sequences);
+        copy_section(bin, bin->heap);
+        if (fflush(bin->fp) != 0)
+            bin->error = 1;
+    }
+
+    for (i = 0; i < DATBIN_COLUMNS; i++)
+        if (bin->column[i] != NULL)
+            fclose(bin->column[i]);
+    if (bin->sequences != NULL)
+        fclose(bin->sequences);
+    if (bin->heap != NULL)
+        fclose(bin->heap);
+
+    status = bin->error ? -1 : 0;
+    free(bin);
+    return status;
+}
+
+/* Checks that a column of count values of the given size lies in the file. */
+static int column_fits(const struct datbinheader *header, int column, size_t width, size_t size)
+{
+    return header->column[column] <= size
+        && header->nrecords <= (size - header->column[column]) / width;
+}
+
+int ConvertDatBinary(const unsigned char *map, size_t size, FILE *fp)
+{
+    struct datbinheader header;
+    const struct datbinsequence *sequences;
+    const int32_t *ints[DATBIN_COLUMNS];
+    const float *floats[DATBIN_COLUMNS];
+    const uint64_t *offsets[DATBIN_COLUMNS];
+    const char *heap;
+    struct datrecord record;
+    struct outbuf *out;
+    uint64_t s, r;
+    int i, ngs;
+
+    if (size < DATBIN_HEADERSIZE)
+        return -1;
+    memcpy(&header, map, DATBIN_HEADERSIZE);
+    if (memcmp(header.magic, DATBIN_MAGIC, sizeof header.magic) != 0
+    || header.byteorder != DATBIN_BYTEORDER || header.columns != DATBIN_COLUMNS
+    || header.version[sizeof header.version - 1] != '\0')
+        return -1;
+
+    for (i = 0; i < DATBIN_COLUMNS; i++) {
+        if (header.column[i] % 8 != 0 || !column_fits(&header, i, i >= DATBIN_PATTERN ? 8 : 4, size))
+            return -1;
+        ints[i] = (const int32_t *)(map + header.column[i]);
+        floats[i] = (const float *)(map + header.column[i]);
+        offsets[i] = (const uint64_t *)(map + header.column[i]);
+    }
+    if (header.sequences % 8 != 0 || header.sequences > size
+    || header.nsequences > (size - header.sequences) / sizeof *sequences
+    || header.heap > size || header.heapsize > size - header.heap
+    || (header.heapsize > 0 && map[header.heap + header.heapsize - 1] != '\0'))
+        return -1;
+    sequences = (const struct datbinsequence *)(map + header.sequences);
+    heap = (const char *)(map + header.heap);
+
+    /* every string must start inside the heap, which ends with a NUL */
+    for (s = 0; s < header.nsequences; s++)
+        if (sequences[s].name >= header.heapsize || sequences[s].firstrecord > header.nrecords
+        || sequences[s].records > header.nrecords - sequences[s].firstrecord)
+            return -1;
+    for (i = DATBIN_PATTERN; i < DATBIN_COLUMNS; i++)
+        for (r = 0; r < header.nrecords; r++)
+            if (offsets[i][r] >= header.heapsize)
+                return -1;
+
+    out = malloc(sizeof *out);
+    if (out == NULL)
+        return -1;
+    InitOutputBuffer(out, fp);
+
+    ngs = (header.flags & DATBIN_NGS) != 0;
+    if (!ngs)
+        OutputDatBanner(out, header.version);
+
+    for (s = 0; s < header.nsequences; s++) {
+        if (!ngs || sequences[s].records > 0)
+            OutputDatSequence(out, heap + sequences[s].name, header.parameters, ngs);
+
+        for (r = sequences[s].firstrecord; r < sequences[s].firstrecord + sequences[s].records; r++) {
+            record.first = ints[DATBIN_FIRST][r];
+            record.last = ints[DATBIN_LAST][r];
+            record.period = ints[DATBIN_PERIOD][r];
+            record.copies = floats[DATBIN_COPIES][r];
+            record.size = ints[DATBIN_SIZE][r];
+            record.matches = ints[DATBIN_MATCHES][r];
+            record.indels = ints[DATBIN_INDELS][r];
+            record.score = ints[DATBIN_SCORE][r];
+            record.acount = ints[DATBIN_ACOUNT][r];
+            record.ccount = ints[DATBIN_CCOUNT][r];
+            record.gcount = ints[DATBIN_GCOUNT][r];
+            record.tcount = ints[DATBIN_TCOUNT][r];
+            record.entropy = floats[DATBIN_ENTROPY][r];
+            record.pattern = heap + offsets[DATBIN_PATTERN][r];
+            record.sequence = heap + offsets[DATBIN_SEQUENCE][r];
+            record.sequencelength = strlen(record.sequence);
+            record.leftflank = record.rightflank = NULL;
+            if (ngs) {
+                record.leftflank = heap + offsets[DATBIN_LEFTFLANK][r];
+                record.leftlength = strlen(record.leftflank);
+                record.rightflank = heap + offsets[DATBIN_RIGHTFLANK][r];
+                record.rightlength = strlen(record.rightflank);
+            }
+            record.edits = NULL;
+            if (header.flags & DATBIN_CIGAR)
+                record.edits = heap + offsets[DATBIN_EDITS][r];
+            OutputDatRecord(out, &record);
+        }
+    }
+
+    FlushOutputBuffer(out);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,155 @@
+#ifndef TRF_DATFILE_H
+#define TRF_DATFILE_H
+
+/*
+Tandem Repeats Finder
+Copyright (C) 1999-2020 Gary Benson
+
+This file is part of the Tandem Repeats Finder (TRF) program.
+
+TRF is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+TRF is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public
+License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/****************************************************************
+ *
+ *   DATFILE.H : .dat output, as text or binary columns
+ *
+ *****************************************************************
+ *   The same records are also written as BED and GFF3 features
+ *   for genome browsers, with -bed and -gff3.
+ *
+ *   The .dat text is written line by line through an outbuf. With
+ *   -binary the same fields are instead stored in a file that can be
+ *   mapped and read as arrays, one column per field:
+ *
+ *   header    DATBIN_HEADERSIZE bytes, see struct datbinheader
+ *   columns   DATBIN_COLUMNS arrays of nrecords values: the int and
+ *             float fields of struct datrecord as 32 bit values, then
+ *             the pattern, sequence, flanks and edit string as 64 bit offsets into
+ *             the heap, each padded to a multiple of 8 bytes
+ *   sequences nsequences struct datbinsequence
+ *   heap      the NUL terminated strings
+ *
+ *   Records of a sequence are consecutive. Values are stored in the
+ *   byte order of the machine that wrote the file, which byteorder
+ *   records. trfdat converts a binary file back to .dat text.
+ *****************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "outbuf.h"
+
+/* one line of .dat output */
+struct datrecord {
+    int first, last, period;
+    float copies;
+    int size, matches, indels, score;
+    int acount, ccount, gcount, tcount;
+    float entropy;
+    const char *pattern;
+    const char *sequence;
+    size_t sequencelength;
+    const char *leftflank, *rightflank;     /* -ngs only, "." at an end */
+    size_t leftlength, rightlength;
+    const char *edits;          /* -cigar only, the last column */
+};
+
+#define DATBIN_MAGIC "TRFDATB\n"
+#define DATBIN_BYTEORDER 0x01020304U
+#define DATBIN_NGS 1            /* -ngs output, with flanks */
+#define DATBIN_CIGAR 2          /* -cigar output, with edit strings */
+
+/* column numbers */
+#define DATBIN_FIRST 0
+#define DATBIN_LAST 1
+#define DATBIN_PERIOD 2
+#define DATBIN_COPIES 3         /* float */
+#define DATBIN_SIZE 4
+#define DATBIN_MATCHES 5
+#define DATBIN_INDELS 6
+#define DATBIN_SCORE 7
+#define DATBIN_ACOUNT 8
+#define DATBIN_CCOUNT 9
+#define DATBIN_GCOUNT 10
+#define DATBIN_TCOUNT 11
+#define DATBIN_ENTROPY 12       /* float */
+#define DATBIN_PATTERN 13       /* the rest are heap offsets */
+#define DATBIN_SEQUENCE 14
+#define DATBIN_LEFTFLANK 15
+#define DATBIN_RIGHTFLANK 16
+#define DATBIN_EDITS 17
+#define DATBIN_COLUMNS 18
+
+struct datbinheader {
+    char magic[8];
+    uint32_t byteorder;
+    uint32_t flags;             /* DATBIN_NGS, DATBIN_CIGAR */
+    uint32_t parameters[7];     /* match, mismatch, indel, PM, PI, minscore, maxperiod */
+    uint32_t columns;           /* DATBIN_COLUMNS */
+    char version[32];
+    uint64_t nsequences, nrecords;
+    uint64_t sequences, heap, heapsize;     /* offsets and size in bytes */
+    uint64_t column[DATBIN_COLUMNS];
+};
+
+#define DATBIN_HEADERSIZE sizeof(struct datbinheader)
+
+struct datbinsequence {
+    uint64_t name;              /* heap offset */
+    uint64_t firstrecord, records;
+};
+
+/* Writes the .dat banner, printed once at the top unless -ngs. */
+void OutputDatBanner(struct outbuf *out, const char *version);
+
+/* Writes the line starting the records of a sequence: @name with -ngs,
+ * the name and parameters otherwise. */
+void OutputDatSequence(struct outbuf *out, const char *name, const unsigned int *parameters, int ngs);
+
+void OutputDatRecord(struct outbuf *out, const struct datrecord *record);
+
+/* Writes a BED6+ line: seqid, start from 0, end, period x copies as
+ * the name, the score capped at 1000 and no strand, then the period,
+ * copies, consensus size, percent matches, percent indels, score, ACGT
+ * counts, entropy and consensus, as the columns of UCSC's simpleRepeat
+ * track. */
+void OutputBedRecord(struct outbuf *out, const char *seqid, const struct datrecord *record);
+
+/* Writes the ##gff-version line that starts a GFF3 file. */
+void OutputGffHeader(struct outbuf *out);
+
+/* Writes a GFF3 tandem_repeat feature, with the fields of the BED line
+ * as attributes. */
+void OutputGffRecord(struct outbuf *out, const char *seqid, const struct datrecord *record);
+
+struct datbinary;
+
+/* Starts a binary .dat file, which FinishDatBinary writes to fp. The
+ * columns are collected in temporary files meanwhile. Returns NULL if
+ * those cannot be created. */
+struct datbinary *CreateDatBinary(FILE *fp, const unsigned int *parameters, const char *version, int ngs,
+    int cigar);
+
+void AddDatBinarySequence(struct datbinary *bin, const char *name);
+void AddDatBinaryRecord(struct datbinary *bin, const struct datrecord *record);
+
+/* Writes the file and frees bin. Returns 0, or -1 on a write error. */
+int FinishDatBinary(struct datbinary *bin);
+
+/* Writes the .dat text of the binary file mapped at map. Returns 0, or
+ * -1 if it is not a valid binary .dat file. */
+int ConvertDatBinary(const unsigned char *map, size_t size, FILE *fp);
+
+#endif
@@ -0,0 +1,319 @@
+/*
+Tandem Repeats Finder
+Copyright (C) 1999-2020 Gary Benson
+
+This file is part of the Tandem Repeats Finder (TRF) program.
+
+TRF is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+TRF is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public
+License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "htmlzip.h"
+
+#define ZIP_LOCALHEADER 0x04034b50U
+#define ZIP_CENTRALHEADER 0x02014b50U
+#define ZIP_END 0x06054b50U
+#define ZIP64_END 0x06064b50U
+#define ZIP64_LOCATOR 0x07064b50U
+
+#define ZIP_VERSION 20          /* 2.0, stored members */
+#define ZIP64_VERSION 45        /* 4.5, ZIP64 records */
+#define ZIP_MADEBYUNIX 0x0300   /* so that the mode below is used */
+#define ZIP_MODE (0100644U << 16)
+
+/* a page collected in memory */
+struct htmlpage {
+    char *name;
+    FILE *fp;                   /* while it is open */
+    char *text;
+    size_t size;
+    struct htmlpage *next;
+};
+
+static FILE *Zipfp;             /* the archive, or NULL */
+static FILE *Zipdirectory;      /* its central directory so far */
+static uint64_t Zipoffset;      /* bytes written to the archive */
+static uint64_t Zipdirectorysize;
+static uint64_t Zipentries;
+static unsigned int Ziptime, Zipdate;   /* MS-DOS time and date */
+static int Ziperror;
+static struct htmlpage *Pages, *Lastpage;
+
+static void put16(unsigned char *p, unsigned int value)
+{
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+}
+
+static void put32(unsigned char *p, uint32_t value)
+{
+    put16(p, value & 0xffff);
+    put16(p + 2, value >> 16);
+}
+
+static void put64(unsigned char *p, uint64_t value)
+{
+    put32(p, (uint32_t)value);
+    put32(p + 4, (uint32_t)(value >> 32));
+}
+
+static void write_bytes(FILE *fp, const void *data, size_t n)
+{
+    if (n > 0 && fwrite(data, 1, n, fp) != n)
+        Ziperror = 1;
+}
+
+int OpenHTMLZip(const char *filename)
+{
+    time_t now;
+    struct tm *local;
+
+    Zipfp = fopen(filename, "wb");
+    if (Zipfp == NULL)
+        return -1;
+    Zipdirectory = tmpfile();
+    if (Zipdirectory == NULL) {
+        fclose(Zipfp);
+        Zipfp = NULL;
+        return -1;
+    }
+    Zipoffset = Zipdirectorysize = Zipentries = 0;
+    Ziperror = 0;
+
+    /* every member gets the time the run started */
+    now = time(NULL);
+    local = localtime(&now);
+    Ziptime = Zipdate = 0;
+    if (local != NULL && local->tm_year >= 80) {
+        Ziptime = (local->tm_hour << 11) | (local->tm_min << 5) | (local->tm_sec / 2);
+        Zipdate = ((local->tm_year - 80) << 9) | ((local->tm_mon + 1) << 5) | local->tm_mday;
+    }
+    return 0;
+}
+
+FILE *OpenHTMLPage(const char *name)
+{
+    struct htmlpage *page;
+
+    if (Zipfp == NULL)
+        return fopen(name, "w");
+
+    page = calloc(1, sizeof *page);
+    if (page == NULL)
+        return NULL;
+    page->name = malloc(strlen(name) + 1);
+    if (page->name == NULL) {
+        free(page);
+        return NULL;
+    }
+    strcpy(page->name, name);
+    page->fp = open_memstream(&page->text, &page->size);
+    if (page->fp == NULL) {
+        free(page->name);
+        free(page);
+        return NULL;
+    }
+
+    if (Pages == NULL)
+        Pages = Lastpage = page;
+    else {
+        Lastpage->next = page;
+        Lastpage = page;
+    }
+    return page->fp;
+}
+
+int CloseHTMLPage(FILE *fp)
+{
+    struct htmlpage *page;
+
+    for (page = Pages; page != NULL; page = page->next)
+        if (page->fp == fp) {
+            page->fp = NULL;
+            break;
+        }
+    return fclose(fp);
+}
+
+/* Writes a page to the archive as a stored member, and adds its entry
+ * to the central directory. */
+static void add_member(const struct htmlpage *page)
+{
+    unsigned char header[30], entry[46], extra[12];
+    size_t namelength, done, n;
+    unsigned long crc;
+    int zip64;
+
+    /* a page is a few thousand repeats at most, far below 4 GB */
+    if (page->size >= 0xffffffffU) {
+        Ziperror = 1;
+        return;
+    }
+
+    crc = crc32(0L, Z_NULL, 0);
+    for (done = 0; done < page->size; done += n) {
+        n = page->size - done;
+        if (n > 0x40000000)
+            n = 0x40000000;
+        crc = crc32(crc, (const Bytef *)page->text + done, (uInt)n);
+    }
+    namelength = strlen(page->name);
+
+    put32(header, ZIP_LOCALHEADER);
+    put16(header + 4, ZIP_VERSION);
+    put16(header + 6, 0);       /* flags */
+    put16(header + 8, 0);       /* stored */
+    put16(header + 10, Ziptime);
+    put16(header + 12, Zipdate);
+    put32(header + 14, (uint32_t)crc);
+    put32(header + 18, (uint32_t)page->size);
+    put32(header + 22, (uint32_t)page->size);
+    put16(header + 26, (unsigned int)namelength);
+    put16(header + 28, 0);      /* no extra field */
+
+    /* past 4 GB the offset moves to a ZIP64 extra field */
+    zip64 = (Zipoffset >= 0xffffffffU);
+    put32(entry, ZIP_CENTRALHEADER);
+    put16(entry + 4, ZIP_MADEBYUNIX | (zip64 ? ZIP64_VERSION : ZIP_VERSION));
+    put16(entry + 6, zip64 ? ZIP64_VERSION : ZIP_VERSION);
+    memcpy(entry + 8, header + 6, 22);  /* flags to name length */
+    put16(entry + 30, zip64 ? sizeof extra : 0);
+    put16(entry + 32, 0);       /* comment */
+    put16(entry + 34, 0);       /* disk */
+    put16(entry + 36, 1);       /* text */
+    put32(entry + 38, ZIP_MODE);
+    put32(entry + 42, zip64 ? 0xffffffffU : (uint32_t)Zipoffset);
+    put16(extra, 1);
+    put16(extra + 2, 8);
+    put64(extra + 4, Zipoffset);
+
+    write_bytes(Zipfp, header, sizeof header);
+    write_bytes(Zipfp, page->name, namelength);
+    write_bytes(Zipfp, page->text, page->size);
+    Zipoffset += sizeof header + namelength + page->size;
+
+    write_bytes(Zipdirectory, entry, sizeof entry);
+    write_bytes(Zipdirectory, page->name, namelength);
+    Zipdirectorysize += sizeof entry + namelength;
+    if (zip64) {
+        write_bytes(Zipdirectory, extra, sizeof extra);
+        Zipdirectorysize += sizeof extra;
+    }
+    Zipentries++;
+}
+
+/* Frees the closed pages, writing them to the archive first if keep is
+ * set. Pages still open, such as the summary, stay in the list. */
+static void end_pages(int keep)
+{
+    struct htmlpage *page, **link;
+
+    link = &Pages;
+    Lastpage = NULL;
+    while ((page = *link) != NULL) {
+        if (page->fp != NULL) {
+            Lastpage = page;
+            link = &page->next;
+            continue;
+        }
+        if (keep)
+            add_member(page);
+        *link = page->next;
+        free(page->text);
+        free(page->name);
+        free(page);
+    }
+}
+
+void CommitHTMLPages(void)
+{
+    if (Zipfp != NULL)
+        end_pages(1);
+}
+
+void DiscardHTMLPages(void)
+{
+    if (Zipfp != NULL)
+        end_pages(0);
+}
+
+int CloseHTMLZip(void)
+{
+    unsigned char record[56], locator[20], end[22];
+    char buffer[65536];
+    uint64_t directory;
+    size_t n;
+    int status;
+
+    if (Zipfp == NULL)
+        return 0;
+    end_pages(1);
+
+    /* the central directory follows the members */
+    directory = Zipoffset;
+    rewind(Zipdirectory);
+    while ((n = fread(buffer, 1, sizeof buffer, Zipdirectory)) > 0)
+        write_bytes(Zipfp, buffer, n);
+    if (ferror(Zipdirectory))
+        Ziperror = 1;
+    fclose(Zipdirectory);
+    Zipdirectory = NULL;
+    Zipoffset += Zipdirectorysize;
+
+    if (Zipentries >= 0xffff || directory >= 0xffffffffU || Zipdirectorysize >= 0xffffffffU) {
+        put32(record, ZIP64_END);
+        put64(record + 4, sizeof record - 12);
+        put16(record + 12, ZIP_MADEBYUNIX | ZIP64_VERSION);
+        put16(record + 14, ZIP64_VERSION);
+        put32(record + 16, 0);  /* disk */
+        put32(record + 20, 0);  /* disk of the directory */
+        put64(record + 24, Zipentries);
+        put64(record + 32, Zipentries);
+        put64(record + 40, Zipdirectorysize);
+        put64(record + 48, directory);
+
+        put32(locator, ZIP64_LOCATOR);
+        put32(locator + 4, 0);
+        put64(locator + 8, Zipoffset);
+        put32(locator + 16, 1); /* disks */
+
+        write_bytes(Zipfp, record, sizeof record);
+        write_bytes(Zipfp, locator, sizeof locator);
+    }
+
+    /* fields too small for their value are all ones, as ZIP64 requires */
+    put32(end, ZIP_END);
+    put16(end + 4, 0);
+    put16(end + 6, 0);
+    put16(end + 8, Zipentries < 0xffff ? (unsigned int)Zipentries : 0xffff);
+    put16(end + 10, Zipentries < 0xffff ? (unsigned int)Zipentries : 0xffff);
+    put32(end + 12, Zipdirectorysize < 0xffffffffU ? (uint32_t)Zipdirectorysize : 0xffffffffU);
+    put32(end + 16, directory < 0xffffffffU ? (uint32_t)directory : 0xffffffffU);
+    put16(end + 20, 0);         /* comment */
+    write_bytes(Zipfp, end, sizeof end);
+
+    if (fclose(Zipfp) != 0)
+        Ziperror = 1;
+    Zipfp = NULL;
+
+    status = Ziperror ? -1 : 0;
+    Ziperror = 0;
+    return status;
+}
@@ -0,0 +1,68 @@
+#ifndef TRF_HTMLZIP_H
+#define TRF_HTMLZIP_H
+
+/*
+Tandem Repeats Finder
+Copyright (C) 1999-2020 Gary Benson
+
+This file is part of the Tandem Repeats Finder (TRF) program.
+
+TRF is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+TRF is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public
+License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/****************************************************************
+ *
+ *   HTMLZIP.H : HTML pages in one ZIP archive, for -zip
+ *
+ *****************************************************************
+ *   Every HTML page (tables, alignments and the summary of a
+ *   multi-sequence run) is opened with OpenHTMLPage and closed with
+ *   CloseHTMLPage. Without an archive these are fopen and fclose.
+ *   Once OpenHTMLZip has been called, pages are instead collected
+ *   in memory, and CommitHTMLPages appends the pages of a sequence
+ *   to the archive as stored (uncompressed) members under their file
+ *   names, or DiscardHTMLPages drops them. The archive is written
+ *   once, front to back, and CloseHTMLZip ends it with the central
+ *   directory, the index of member offsets. ZIP64 records are added
+ *   when there are 65535 members or more, or the archive passes
+ *   4 GB, so that any number of sequences fits. The links between
+ *   pages are relative, so the summary links into the archive.
+ *****************************************************************/
+
+#include <stdio.h>
+
+/* Starts the archive in filename. Returns 0, or -1 if it cannot be
+ * created. */
+int OpenHTMLZip(const char *filename);
+
+/* Opens a page for writing, as fopen(name, "w"). Returns NULL on
+ * failure. */
+FILE *OpenHTMLPage(const char *name);
+
+/* Closes a page opened with OpenHTMLPage. Returns 0, or EOF on error,
+ * as fclose. */
+int CloseHTMLPage(FILE *fp);
+
+/* Appends the closed pages to the archive. Does nothing without one. */
+void CommitHTMLPages(void);
+
+/* Drops the closed pages. Does nothing without an archive. */
+void DiscardHTMLPages(void);
+
+/* Appends the closed pages, writes the central directory and closes
+ * the archive. Every page must have been closed. Returns 0, or -1 on a
+ * write error. */
+int CloseHTMLZip(void);
+
+#endif
@@ -2,6 +2,21 @@
 
 #include "indexlist.h"
 
+void FreeAlignmentRecord(struct alignrecord *record)
+{
+    if (record != NULL)
+        free(record->distances);
+    free(record);
+}
+
+void FreeListEntry(struct index_list *entry)
+{
+    FreeAlignmentRecord(entry->il_record);
+    free(entry->il_edits);
+    free(entry->il_pattern);
+    free(entry);
+}
+
 void FreeList(struct index_list *headptr)
 {
     struct index_list *nextptr;
@@ -11,8 +26,7 @@ void FreeList(struct index_list *headptr)
     while (nextptr != NULL) {
         holdptr = nextptr;
         nextptr = nextptr->il_next;
-        free(holdptr->il_pattern);
-        free(holdptr);
+        FreeListEntry(holdptr);
     }
 
     return;
@@ -1,6 +1,19 @@
 #ifndef TRF_INDEXLIST_H
 #define TRF_INDEXLIST_H
 
+/* what the alignment file shows for a repeat besides its alignment, kept
+ * so the text need only be written if the repeat survives TRFClean */
+struct alignrecord {
+    int score;                     /* as Maxscore */
+    double copynumber;             /* as Copynumber, unrounded */
+    int outputcount;               /* OUTPUTcount, for the anchor name */
+    int match, mismatch, indel;
+    int ndistances;
+    int *distances;                /* distance and match count pairs */
+    int acgtcount[4];              /* letters of the repeat */
+    int count;
+};
+
 struct index_list {
     int il_count;                  /* indicates order in original file */
     char il_ref[45];               /* records label for linking */
@@ -18,10 +31,15 @@ struct index_list {
     int il_tcount;
     float il_entropy;
     char *il_pattern;
+    int il_alignment;              /* its alignment text, see MarkAlignment, or -1 */
+    char *il_edits;                /* run-length edit string, or NULL */
+    struct alignrecord *il_record; /* alignment still to print, or NULL */
 
     struct index_list *il_next;
 };
 
+void FreeAlignmentRecord(struct alignrecord *record);
+void FreeListEntry(struct index_list *entry);
 void FreeList(struct index_list *headptr);
 
 #endif
@@ -0,0 +1,121 @@
+/*
+Tandem Repeats Finder
+Copyright (C) 1999-2020 Gary Benson
+
+This file is part of the Tandem Repeats Finder (TRF) program.
+
+TRF is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+TRF is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public
+License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "outbuf.h"
+
+void InitOutputBuffer(struct outbuf *out, FILE *fp)
+{
+    out->fp = fp;
+    out->length = 0;
+}
+
+void FlushOutputBuffer(struct outbuf *out)
+{
+    if (out->length > 0)
+        fwrite(out->data, 1, out->length, out->fp);
+    out->length = 0;
+}
+
+void OutputSpan(struct outbuf *out, const char *text, size_t n)
+{
+    if (out->length + n > OUTBUFSIZE) {
+        FlushOutputBuffer(out);
+
+        /* spans as large as the buffer go straight out */
+        if (n >= OUTBUFSIZE) {
+            fwrite(text, 1, n, out->fp);
+            return;
+        }
+    }
+
+    memcpy(out->data + out->length, text, n);
+    out->length += n;
+}
+
+void OutputString(struct outbuf *out, const char *text)
+{
+    OutputSpan(out, text, strlen(text));
+}
+
+void OutputChar(struct outbuf *out, char c)
+{
+    if (out->length == OUTBUFSIZE)
+        FlushOutputBuffer(out);
+    out->data[out->length++] = c;
+}
+
+/* Writes the decimal digits of value, padded with zeros to at least
+ * width digits. */
+static void output_digits(struct outbuf *out, unsigned long long value, int width)
+{
+    char digits[24];
+    int k = sizeof digits;
+
+    do {
+        digits[--k] = (char)('0' + value % 10);
+        value /= 10;
+        width--;
+    } while (value > 0 || width > 0);
+
+    OutputSpan(out, digits + k, sizeof digits - k);
+}
+
+void OutputInt(struct outbuf *out, int value)
+{
+    if (value < 0) {
+        OutputChar(out, '-');
+        output_digits(out, -(unsigned long long)value, 1);
+    }
+    else {
+        output_digits(out, (unsigned long long)value, 1);
+    }
+}
+
+void OutputFixed(struct outbuf *out, double value, int decimals)
+{
+    static const double scale[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    static const unsigned long long units[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    char text[64];
+    double scaled, whole;
+    unsigned long long rounded;
+
+    /* printf rounds the exact binary value, ties to even. value * scale
+     * is within a few units in the last place of it, which can only
+     * matter next to a tie, so those and any unusual values are left to
+     * snprintf. */
+    scaled = value * scale[decimals];
+    whole = floor(scaled);
+    if (!(value >= 0 && value < 1e6) || fabs(scaled - whole - 0.5) < 1e-6) {
+        snprintf(text, sizeof text, "%.*f", decimals, value);
+        OutputString(out, text);
+        return;
+    }
+
+    rounded = (unsigned long long)whole + (scaled - whole > 0.5);
+    output_digits(out, rounded / units[decimals], 1);
+    if (decimals > 0) {
+        OutputChar(out, '.');
+        output_digits(out, rounded % units[decimals], decimals);
+    }
+}
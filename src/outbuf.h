@@ -0,0 +1,64 @@
+#ifndef TRF_OUTBUF_H
+#define TRF_OUTBUF_H
+
+/*
+Tandem Repeats Finder
+Copyright (C) 1999-2020 Gary Benson
+
+This file is part of the Tandem Repeats Finder (TRF) program.
+
+TRF is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+TRF is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public
+License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/****************************************************************
+ *
+ *   OUTBUF.H : Buffered output of records
+ *
+ *****************************************************************
+ *   The .dat output has one line per repeat, holding the repeat
+ *   and, with -ngs, its flanks. These are copied into a large
+ *   buffer as whole spans, and the numbers are formatted by hand,
+ *   so writing a line takes a few memcpy calls rather than one
+ *   printf call per character. The bytes written are the same as
+ *   printf's "%d" and "%.nf".
+ *****************************************************************/
+
+#include <stdio.h>
+
+/* bytes collected before they are written */
+#define OUTBUFSIZE (1024 * 1024)
+
+struct outbuf {
+    FILE *fp;
+    size_t length;              /* bytes in data */
+    char data[OUTBUFSIZE];
+};
+
+/* Starts collecting output for fp. Anything written to fp directly must
+ * come after a FlushOutputBuffer. */
+void InitOutputBuffer(struct outbuf *out, FILE *fp);
+
+void FlushOutputBuffer(struct outbuf *out);
+
+void OutputSpan(struct outbuf *out, const char *text, size_t n);
+void OutputString(struct outbuf *out, const char *text);
+void OutputChar(struct outbuf *out, char c);
+
+/* as printf's "%d" */
+void OutputInt(struct outbuf *out, int value);
+
+/* as printf's "%.*f", with decimals from 0 to 6 */
+void OutputFixed(struct outbuf *out, double value, int decimals);
+
+#endif
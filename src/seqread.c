@@ -0,0 +1,1148 @@
+/*
+Tandem Repeats Finder
+Copyright (C) 1999-2020 Gary Benson
+
+This file is part of the Tandem Repeats Finder (TRF) program.
+
+TRF is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+TRF is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public
+License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "seqread.h"
+#include "trfrun.h"
+#include "tr30dat.h"
+
+/* smallest sequence buffer, grown by doubling */
+#define SEQMINALLOC (64 * 1024)
+
+/* most bytes a BGZF block inflates to */
+#define BGZFBLOCKSIZE 65536
+
+/* first word of a .2bit file, and the size of its header */
+#define TWOBITSIGNATURE 0x1A412743U
+#define TWOBITHEADER 16
+
+/* one line of a .fai index */
+struct faientry {
+    char *name;
+    size_t length, offset;      /* bases, and file offset of the first */
+    size_t linebases, linewidth;    /* per line, without and with the line break */
+};
+
+/* upper case letter for each byte that is a letter, 0 for the rest */
+static unsigned char Seqletter[256];
+
+/* the four bases packed in a .2bit byte, first base in the high bits */
+static char Twobitbases[256][4];
+
+static void init_seqletter(void)
+{
+    int c, k;
+
+    if (Seqletter['A'])
+        return;
+
+    for (c = 'A'; c <= 'Z'; c++) {
+        Seqletter[c] = (unsigned char)c;
+        Seqletter[c - 'A' + 'a'] = (unsigned char)c;
+    }
+
+    for (c = 0; c < 256; c++)
+        for (k = 0; k < 4; k++)
+            Twobitbases[c][k] = "TCAG"[(c >> (6 - 2 * k)) & 3];
+}
+
+/* Maps fp if it is a regular file not yet read from. Returns 1 if the
+ * file is now in reader->map, 0 if it must be read instead. */
+static int map_file(struct seqreader *reader, FILE *fp)
+{
+    struct stat st;
+    void *map;
+
+    if (fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0
+        || (unsigned long long)st.st_size > (size_t)-1 || ftell(fp) != 0)
+        return 0;
+
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+    if (map == MAP_FAILED)
+        return 0;
+
+#ifdef MADV_SEQUENTIAL
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+
+    reader->map = map;
+    reader->mapsize = (size_t)st.st_size;
+    reader->mappos = 0;
+    return 1;
+}
+
+/* gzip member header at p, with n bytes available */
+static int is_gzip(const unsigned char *p, size_t n)
+{
+    return n >= 18 && p[0] == 0x1f && p[1] == 0x8b && p[2] == 8;
+}
+
+/* Size of the BGZF block at p, with n bytes available, or 0 if it is not
+ * one. The block size is kept in the 'BC' extra subfield. */
+static size_t bgzf_block_size(const unsigned char *p, size_t n)
+{
+    size_t xlen, x, size;
+
+    if (!is_gzip(p, n) || !(p[3] & 4))
+        return 0;
+
+    xlen = p[10] | (size_t)p[11] << 8;
+    for (x = 12; x + 4 <= 12 + xlen && x + 4 <= n; x += 4 + (p[x + 2] | (size_t)p[x + 3] << 8)) {
+        if (p[x] == 'B' && p[x + 1] == 'C' && p[x + 2] == 2 && p[x + 3] == 0) {
+            size = (p[x + 4] | (size_t)p[x + 5] << 8) + 1;
+            if (size < 12 + xlen + 8 || size > n)
+                return 0;
+            return size;
+        }
+    }
+
+    return 0;
+}
+
+/* 32 bit word of the mapped .2bit file at pos, in the file's byte order */
+static unsigned int twobit_word(struct seqreader *reader, size_t pos)
+{
+    const unsigned char *p = reader->map + pos;
+
+    if (reader->swapped)
+        return (unsigned int)p[0] << 24 | (unsigned int)p[1] << 16 | (unsigned int)p[2] << 8 | p[3];
+    return (unsigned int)p[3] << 24 | (unsigned int)p[2] << 16 | (unsigned int)p[1] << 8 | p[0];
+}
+
+/* Recognizes a mapped .2bit file and positions the reader at the first
+ * entry of its index. Returns 1 if it is one. */
+static int open_twobit(struct seqreader *reader)
+{
+    unsigned int version;
+
+    if (reader->mapsize < TWOBITHEADER)
+        return 0;
+
+    reader->swapped = 0;
+    if (twobit_word(reader, 0) != TWOBITSIGNATURE) {
+        reader->swapped = 1;
+        if (twobit_word(reader, 0) != TWOBITSIGNATURE)
+            return 0;
+    }
+
+    version = twobit_word(reader, 4);
+    reader->source = SEQREAD_TWOBIT;
+    reader->wideoffsets = (version == 1);
+    reader->records = twobit_word(reader, 8);
+    reader->mappos = TWOBITHEADER;
+    if (version > 1)
+        reader->error = 1;
+    return 1;
+}
+
+struct seqreader *OpenSequenceReader(FILE *fp)
+{
+    struct seqreader *reader;
+    z_stream *zs;
+    long n;
+
+    init_seqletter();
+
+    reader = calloc(1, sizeof *reader);
+    if (reader == NULL)
+        return NULL;
+    reader->fp = fp;
+
+    if (map_file(reader, fp)) {
+        if (open_twobit(reader))
+            return reader;
+
+        if (!is_gzip(reader->map, reader->mapsize)) {
+            reader->source = SEQREAD_MAPPED;
+            reader->buffer = reader->map;
+            reader->end = reader->mapsize;
+            return reader;
+        }
+
+        if (bgzf_block_size(reader->map, reader->mapsize)) {
+            reader->source = SEQREAD_BGZF;
+            n = sysconf(_SC_NPROCESSORS_ONLN);
+            reader->threads = (int)min(max(n, 1), BGZFMAXTHREADS);
+            reader->buffer = malloc(BGZFBATCH * BGZFBLOCKSIZE);
+        }
+        else {
+            reader->source = SEQREAD_GZIP;
+            reader->buffer = malloc(SEQREADBLOCK);
+            zs = calloc(1, sizeof *zs);
+            if (zs == NULL || inflateInit2(zs, 15 + 16) != Z_OK) {
+                free(zs);
+                zs = NULL;
+            }
+            reader->stream = zs;
+            if (zs == NULL) {
+                CloseSequenceReader(reader);
+                return NULL;
+            }
+        }
+    }
+    else {
+        /* zlib passes data that is not gzip through unchanged */
+        reader->source = SEQREAD_STREAM;
+        reader->buffer = malloc(SEQREADBLOCK);
+        reader->stream = gzdopen(dup(fileno(fp)), "rb");
+        if (reader->stream == NULL) {
+            CloseSequenceReader(reader);
+            return NULL;
+        }
+        gzbuffer(reader->stream, SEQREADBLOCK);
+    }
+
+    if (reader->buffer == NULL) {
+        CloseSequenceReader(reader);
+        return NULL;
+    }
+
+    return reader;
+}
+
+void CloseSequenceReader(struct seqreader *reader)
+{
+    if (reader == NULL)
+        return;
+
+    if (reader->source == SEQREAD_STREAM && reader->stream != NULL)
+        gzclose(reader->stream);
+    if (reader->source == SEQREAD_GZIP && reader->stream != NULL) {
+        inflateEnd(reader->stream);
+        free(reader->stream);
+    }
+    if (reader->map != NULL)
+        munmap(reader->map, reader->mapsize);
+    while (reader->faicount > 0)
+        free(reader->fai[--reader->faicount].name);
+    free(reader->fai);
+    if (reader->source != SEQREAD_MAPPED && reader->source != SEQREAD_TWOBIT)
+        free(reader->buffer);
+
+    fclose(reader->fp);
+    free(reader);
+}
+
+/* Inflates the gzip members of the mapped file into the buffer. Returns
+ * the number of bytes produced, 0 at the end of the input. The stream is
+ * freed once the last member is complete. */
+static size_t inflate_mapped(struct seqreader *reader)
+{
+    z_stream *zs = reader->stream;
+    int status;
+
+    if (zs == NULL)
+        return 0;
+
+    zs->next_out = reader->buffer;
+    zs->avail_out = SEQREADBLOCK;
+    while (zs->avail_out > 0) {
+        if (zs->avail_in == 0) {
+            /* the input ran out inside a member */
+            if (reader->mappos == reader->mapsize) {
+                reader->error = 1;
+                break;
+            }
+            zs->next_in = reader->map + reader->mappos;
+            zs->avail_in = (uInt)min(reader->mapsize - reader->mappos, (size_t)1 << 30);
+            reader->mappos += zs->avail_in;
+        }
+
+        status = inflate(zs, Z_NO_FLUSH);
+        if (status == Z_STREAM_END) {
+            if (zs->avail_in == 0 && reader->mappos == reader->mapsize) {
+                status = SEQREADBLOCK - zs->avail_out;
+                inflateEnd(zs);
+                free(zs);
+                reader->stream = NULL;
+                return status;
+            }
+
+            /* another member follows, as in concatenated files */
+            inflateReset(zs);
+        }
+        else if (status != Z_OK && status != Z_BUF_ERROR) {
+            reader->error = 1;
+            break;
+        }
+    }
+
+    return SEQREADBLOCK - zs->avail_out;
+}
+
+struct bgzfblock {
+    const unsigned char *in;    /* deflate data */
+    size_t insize;
+    unsigned char *out;
+    size_t outsize;             /* from the block footer */
+};
+
+struct bgzfwork {
+    struct bgzfblock *blocks;
+    int count, first, step;
+    int error;
+};
+
+/* inflates blocks first, first+step, ... of a batch */
+static void *inflate_bgzf_blocks(void *arg)
+{
+    struct bgzfwork *work = arg;
+    struct bgzfblock *block;
+    z_stream zs;
+    int b;
+
+    memset(&zs, 0, sizeof zs);
+    if (inflateInit2(&zs, -15) != Z_OK) {
+        work->error = 1;
+        return NULL;
+    }
+
+    for (b = work->first; b < work->count; b += work->step) {
+        block = &work->blocks[b];
+        inflateReset(&zs);
+        zs.next_in = (unsigned char *)block->in;
+        zs.avail_in = (uInt)block->insize;
+        zs.next_out = block->out;
+        zs.avail_out = (uInt)block->outsize;
+        if (inflate(&zs, Z_FINISH) != Z_STREAM_END || zs.avail_out != 0) {
+            work->error = 1;
+            break;
+        }
+    }
+
+    inflateEnd(&zs);
+    return NULL;
+}
+
+/* Inflates the next batch of BGZF blocks of the mapped file into the
+ * buffer, in parallel. Each block's inflated size is in its footer, so
+ * every block can be given its place in the buffer up front. Returns the
+ * number of bytes produced, 0 at the end of the input. */
+static size_t inflate_bgzf(struct seqreader *reader)
+{
+    struct bgzfblock blocks[BGZFBATCH];
+    struct bgzfwork work[BGZFMAXTHREADS];
+    pthread_t thread[BGZFMAXTHREADS];
+    const unsigned char *p;
+    size_t size, total, xlen;
+    int count, threads, t;
+
+    total = 0;
+    for (count = 0; count < BGZFBATCH && reader->mappos < reader->mapsize; count++) {
+        p = reader->map + reader->mappos;
+        size = bgzf_block_size(p, reader->mapsize - reader->mappos);
+        if (size == 0) {
+            reader->error = 1;
+            break;
+        }
+
+        xlen = p[10] | (size_t)p[11] << 8;
+        blocks[count].in = p + 12 + xlen;
+        blocks[count].insize = size - 12 - xlen - 8;
+        blocks[count].outsize = p[size - 4] | (size_t)p[size - 3] << 8
+            | (size_t)p[size - 2] << 16 | (size_t)p[size - 1] << 24;
+        if (blocks[count].outsize > BGZFBLOCKSIZE) {
+            reader->error = 1;
+            break;
+        }
+        blocks[count].out = reader->buffer + total;
+        total += blocks[count].outsize;
+        reader->mappos += size;
+    }
+
+    threads = min(reader->threads, count);
+    for (t = 0; t < threads; t++) {
+        work[t].blocks = blocks;
+        work[t].count = count;
+        work[t].first = t;
+        work[t].step = threads;
+        work[t].error = 0;
+    }
+
+    /* the first share is inflated by this thread */
+    for (t = 1; t < threads; t++) {
+        if (pthread_create(&thread[t], NULL, inflate_bgzf_blocks, &work[t]) != 0) {
+            work[t].error = 1;
+            threads = t;
+        }
+    }
+    if (threads > 0)
+        inflate_bgzf_blocks(&work[0]);
+    for (t = 1; t < threads; t++)
+        pthread_join(thread[t], NULL);
+
+    for (t = 0; t < threads; t++)
+        if (work[t].error)
+            reader->error = 1;
+
+    return reader->error ? 0 : total;
+}
+
+/* gzread returns 0 both at the end of the input and when it ends inside
+ * a member, which gzerror reports as Z_BUF_ERROR. Returns 1 for that
+ * or any other error, otherwise 0. */
+static int gzread_failed(gzFile stream)
+{
+    int status;
+
+    gzerror(stream, &status);
+    return status != Z_OK && status != Z_STREAM_END;
+}
+
+/* Refills an empty buffer. Returns the number of bytes read, 0 at the
+ * end of the input. */
+static size_t fill_buffer(struct seqreader *reader)
+{
+    int n;
+
+    reader->pos = reader->end = 0;
+    switch (reader->source) {
+        case SEQREAD_MAPPED:
+        case SEQREAD_TWOBIT:
+            /* a mapped file is in the buffer from the start */
+            break;
+
+        case SEQREAD_GZIP:
+            reader->end = inflate_mapped(reader);
+            break;
+
+        case SEQREAD_BGZF:
+            /* a batch may hold only empty blocks, as the end of file marker */
+            while (reader->end == 0 && reader->mappos < reader->mapsize && !reader->error)
+                reader->end = inflate_bgzf(reader);
+            break;
+
+        case SEQREAD_STREAM:
+            n = gzread(reader->stream, reader->buffer, SEQREADBLOCK);
+            if (n > 0)
+                reader->end = n;
+            else if (n < 0 || gzread_failed(reader->stream))
+                reader->error = 1;
+            break;
+    }
+
+    return reader->end;
+}
+
+/* next byte of the input, or EOF */
+static int read_byte(struct seqreader *reader)
+{
+    if (reader->pos == reader->end && fill_buffer(reader) == 0)
+        return EOF;
+
+    return reader->buffer[reader->pos++];
+}
+
+/* Copies the letters of src[0..n-1] to dest in upper case and adds every
+ * byte to counts. Returns the number of letters copied. */
+static size_t copy_letters(char *dest, const unsigned char *src, size_t n, size_t *counts)
+{
+    size_t i, k;
+    unsigned char c;
+
+    for (i = k = 0; i < n; i++) {
+        c = Seqletter[src[i]];
+        dest[k] = (char)c;
+        k += (c != 0);
+        counts[c]++;
+    }
+
+    return k;
+}
+
+/* the sequence being loaded, before it is stored in a fastasequence */
+struct seqtext {
+    char *text;
+    size_t length, size;
+    size_t counts[256];         /* letters copied, see copy_letters */
+};
+
+/* Appends the letters of p[0..n-1]. Returns 0, or -1 if out of memory. */
+static int append_letters(struct seqtext *seq, const unsigned char *p, size_t n)
+{
+    size_t needed;
+    char *ptemp;
+
+    needed = seq->length + n + 1;
+    if (needed > seq->size) {
+        seq->size = max(max(2 * seq->size, needed), SEQMINALLOC);
+        if ((ptemp = realloc(seq->text, seq->size)) == NULL) {
+            PrintError("Insufficient memory");
+            return -1;
+        }
+        seq->text = ptemp;
+    }
+
+    seq->length += copy_letters(seq->text + seq->length, p, n, seq->counts);
+    return 0;
+}
+
+/* Reads FASTA sequence text up to the next '>', which is left unread,
+ * or until limit letters have been read. Returns 1 if a '>' was found, 0
+ * at the end of the input, 2 if the limit was reached and more letters
+ * follow, or -1. */
+static int load_fasta_text(struct seqreader *reader, struct seqtext *seq, size_t limit)
+{
+    unsigned char *p, *gt;
+    size_t span;
+
+    for (;;) {
+        if (reader->pos == reader->end && fill_buffer(reader) == 0)
+            return 0;
+
+        p = reader->buffer + reader->pos;
+        if (seq->length == limit) {
+            /* skip line breaks to see whether the record goes on */
+            if (*p == '>')
+                return 1;
+            if (Seqletter[*p])
+                return 2;
+            reader->pos++;
+            continue;
+        }
+
+        /* there are never more letters than bytes, so span bytes fit */
+        gt = memchr(p, '>', reader->end - reader->pos);
+        span = gt ? (size_t)(gt - p) : reader->end - reader->pos;
+        if (span > limit - seq->length) {
+            span = limit - seq->length;
+            gt = NULL;
+        }
+        if (append_letters(seq, p, span) < 0)
+            return -1;
+        reader->pos += span;
+
+        if (gt)
+            return 1;
+    }
+}
+
+/* Reads the sequence lines of a FASTQ record, skips the '+' line and as
+ * many quality characters as there were sequence characters, without
+ * copying them. Returns 1 if another record follows, 0 at the end of the
+ * input, or -1. */
+static int load_fastq_text(struct seqreader *reader, struct seqtext *seq)
+{
+    unsigned char *p, *nl;
+    size_t span, k, characters;
+    int c, linestart;
+
+    /* sequence lines, up to a line starting with '+' */
+    characters = 0;
+    linestart = 1;
+    for (;;) {
+        if (reader->pos == reader->end && fill_buffer(reader) == 0) {
+            PrintError("FASTQ input terminated too early");
+            return -1;
+        }
+
+        p = reader->buffer + reader->pos;
+        if (linestart && *p == '+')
+            break;
+
+        nl = memchr(p, '\n', reader->end - reader->pos);
+        span = nl ? (size_t)(nl - p) + 1 : reader->end - reader->pos;
+        if (append_letters(seq, p, span) < 0)
+            return -1;
+        for (k = 0; k < span; k++)
+            characters += (p[k] != '\n' && p[k] != '\r');
+        reader->pos += span;
+        linestart = (nl != NULL);
+    }
+
+    /* the '+' line may repeat the name */
+    do
+        c = read_byte(reader);
+    while (c != '\n' && c != EOF);
+
+    /* quality characters may be any printable character, even '@' */
+    while (characters > 0) {
+        c = read_byte(reader);
+        if (c == EOF) {
+            PrintError("FASTQ input terminated too early");
+            return -1;
+        }
+        characters -= (c != '\n' && c != '\r');
+    }
+
+    /* rest of the quality line and blank lines */
+    for (;;) {
+        if (reader->pos == reader->end && fill_buffer(reader) == 0)
+            return 0;
+        c = reader->buffer[reader->pos];
+        if (c == '@')
+            return 1;
+        if (c != '\n' && c != '\r') {
+            PrintError("Bad FASTQ record");
+            return -1;
+        }
+        reader->pos++;
+    }
+}
+
+static int twobit_error(struct seqreader *reader)
+{
+    PrintError("Bad .2bit file");
+    reader->error = 1;
+    return -1;
+}
+
+/* Decodes the next .2bit record. The index entry gives the name and
+ * the offset of the record, which holds the number of bases, the N-block
+ * and mask-block tables, and the packed bases. Mask blocks only mark
+ * lower case, which is not kept. Returns as LoadSequence. */
+static int load_twobit(struct seqreader *reader, struct fastasequence *pseq)
+{
+    size_t counts[256], namesize, pos, offset, dnasize, nblocks, maskblocks, packed, b, k, first, size;
+    const unsigned char *dna;
+    char *text;
+    int i;
+
+    if (reader->error)
+        return twobit_error(reader);
+    if (reader->records == 0)
+        return -1;
+
+    /* index entry */
+    pos = reader->mappos;
+    if (pos + 1 > reader->mapsize)
+        return twobit_error(reader);
+    namesize = reader->map[pos];
+    if (pos + 1 + namesize + (reader->wideoffsets ? 8 : 4) > reader->mapsize)
+        return twobit_error(reader);
+    k = min(namesize, (size_t)MAXSEQNAMELEN - 1);
+    memcpy(pseq->name, reader->map + pos + 1, k);
+    pseq->name[k] = '\0';
+    pos += 1 + namesize;
+    if (reader->wideoffsets) {
+        offset = reader->swapped
+            ? (size_t)twobit_word(reader, pos) << 32 | twobit_word(reader, pos + 4)
+            : (size_t)twobit_word(reader, pos + 4) << 32 | twobit_word(reader, pos);
+        pos += 8;
+    }
+    else {
+        offset = twobit_word(reader, pos);
+        pos += 4;
+    }
+    reader->mappos = pos;
+    reader->records--;
+
+    /* record header and block tables */
+    if (offset + 8 > reader->mapsize)
+        return twobit_error(reader);
+    dnasize = twobit_word(reader, offset);
+    nblocks = twobit_word(reader, offset + 4);
+    pos = offset + 8 + 8 * nblocks;
+    if (pos + 4 > reader->mapsize)
+        return twobit_error(reader);
+    maskblocks = twobit_word(reader, pos);
+    pos += 4 + 8 * maskblocks + 4;
+    packed = (dnasize + 3) / 4;
+    if (pos + packed > reader->mapsize)
+        return twobit_error(reader);
+    dna = reader->map + pos;
+
+    text = malloc(dnasize + 1);
+    if (text == NULL) {
+        PrintError("Insufficient memory");
+        return -1;
+    }
+
+    /* whole bytes, counting the bytes to get the composition */
+    memset(counts, 0, sizeof counts);
+    for (b = 0; b < dnasize / 4; b++) {
+        memcpy(text + 4 * b, Twobitbases[dna[b]], 4);
+        counts[dna[b]]++;
+    }
+    for (k = 4 * b; k < dnasize; k++)
+        text[k] = Twobitbases[dna[b]][k - 4 * b];
+    text[dnasize] = '\0';
+
+    for (i = 0; i < 26; i++)
+        pseq->composition[i] = 0;
+    for (b = 0; b < 256; b++)
+        for (k = 0; k < 4; k++)
+            pseq->composition[Twobitbases[b][k] - 'A'] += (int)counts[b];
+    for (k = 4 * (dnasize / 4); k < dnasize; k++)
+        pseq->composition[text[k] - 'A']++;
+
+    /* Ns, which are stored as T */
+    for (b = 0; b < nblocks; b++) {
+        first = twobit_word(reader, offset + 8 + 4 * b);
+        size = twobit_word(reader, offset + 8 + 4 * nblocks + 4 * b);
+        if (first > dnasize || size > dnasize - first) {
+            free(text);
+            return twobit_error(reader);
+        }
+        for (k = first; k < first + size; k++)
+            pseq->composition[text[k] - 'A']--;
+        memset(text + first, 'N', size);
+        pseq->composition['N' - 'A'] += (int)size;
+    }
+
+    pseq->sequence = text;
+    pseq->length = (unsigned int)dnasize;
+    pseq->nucleotides =
+        pseq->composition['A' - 'A'] + pseq->composition['C' - 'A'] +
+        pseq->composition['G' - 'A'] + pseq->composition['T' - 'A'];
+
+    return reader->records > 0;
+}
+
+/* Moves the loaded text and its composition into pseq. */
+static void store_sequence(struct seqtext *seq, struct fastasequence *pseq)
+{
+    int i;
+
+    seq->text[seq->length] = '\0';  /* terminate sequence text as a string */
+    pseq->sequence = seq->text;
+    pseq->length = (unsigned int)seq->length;
+
+    for (i = 0; i < 26; i++)
+        pseq->composition[i] = (int)seq->counts['A' + i];
+    pseq->nucleotides =
+        pseq->composition['A' - 'A'] + pseq->composition['C' - 'A'] +
+        pseq->composition['G' - 'A'] + pseq->composition['T' - 'A'];
+}
+
+static int compare_fai_names(const void *a, const void *b)
+{
+    return strcmp(((const struct faientry *)a)->name, ((const struct faientry *)b)->name);
+}
+
+static struct faientry *find_fai_entry(struct seqreader *reader, const char *name)
+{
+    struct faientry key;
+
+    key.name = (char *)name;
+    return bsearch(&key, reader->fai, reader->faicount, sizeof key, compare_fai_names);
+}
+
+/* file offset of base p, counting from 0 */
+static size_t fai_offset(const struct faientry *entry, size_t p)
+{
+    return entry->offset + p / entry->linebases * entry->linewidth + p % entry->linebases;
+}
+
+/* Reads the .fai file into reader->fai. Returns 0, or -1. */
+static int read_fai(struct seqreader *reader, const char *indexpath)
+{
+    FILE *fp;
+    char *line = NULL, *name, *fields[4];
+    size_t size = 0, allocated = 0;
+    struct faientry *entry, *ptemp;
+    unsigned long long value[4];
+    int k, status = 0;
+
+    fp = fopen(indexpath, "r");
+    if (fp == NULL) {
+        PrintError("Unable to open the FASTA index. Run samtools faidx on the input first.");
+        return -1;
+    }
+
+    while (status == 0 && getline(&line, &size, fp) != -1) {
+        if (line[0] == '\n')
+            continue;
+
+        name = strtok(line, "\t");
+        for (k = 0; k < 4; k++) {
+            fields[k] = strtok(NULL, "\t\r\n");
+            if (fields[k] == NULL || sscanf(fields[k], "%llu", &value[k]) != 1)
+                break;
+        }
+        if (k < 4 || value[2] == 0 || value[3] < value[2]) {
+            PrintError("Bad FASTA index");
+            status = -1;
+            break;
+        }
+
+        if (reader->faicount == allocated) {
+            allocated = max(2 * allocated, 64);
+            ptemp = realloc(reader->fai, allocated * sizeof *reader->fai);
+            if (ptemp == NULL) {
+                PrintError("Insufficient memory");
+                status = -1;
+                break;
+            }
+            reader->fai = ptemp;
+        }
+        entry = &reader->fai[reader->faicount];
+        entry->name = strdup(name);
+        if (entry->name == NULL) {
+            PrintError("Insufficient memory");
+            status = -1;
+            break;
+        }
+        entry->length = value[0];
+        entry->offset = value[1];
+        entry->linebases = value[2];
+        entry->linewidth = value[3];
+        reader->faicount++;
+    }
+
+    free(line);
+    fclose(fp);
+    if (status == 0)
+        qsort(reader->fai, reader->faicount, sizeof *reader->fai, compare_fai_names);
+    return status;
+}
+
+int SetSequenceRegions(struct seqreader *reader, const char *indexpath,
+    struct seqregion *regions, int count)
+{
+    struct faientry *entry;
+    char message[1000];
+    int r;
+
+    if (reader->source != SEQREAD_MAPPED) {
+        PrintError("Regions can only be read from an uncompressed FASTA file");
+        return -1;
+    }
+    if (read_fai(reader, indexpath) < 0)
+        return -1;
+
+    for (r = 0; r < count; r++) {
+        entry = find_fai_entry(reader, regions[r].name);
+        if (entry == NULL) {
+            snprintf(message, sizeof message, "Sequence %.900s is not in the FASTA index", regions[r].name);
+            PrintError(message);
+            return -1;
+        }
+        if (regions[r].end == 0 || regions[r].end > entry->length)
+            regions[r].end = (unsigned int)entry->length;
+        if (regions[r].start > regions[r].end) {
+            snprintf(message, sizeof message, "Region %.900s:%u-%u is empty",
+                regions[r].name, regions[r].start, regions[r].end);
+            PrintError(message);
+            return -1;
+        }
+    }
+
+    reader->regions = regions;
+    reader->regioncount = count;
+    reader->nextregion = 0;
+    return 0;
+}
+
+/* Loads the next region, named name:start-end, copying the letters
+ * between the offsets of its first and last base in the mapped file.
+ * Returns as LoadSequence. */
+static int load_region(struct seqreader *reader, struct fastasequence *pseq)
+{
+    struct seqregion *region;
+    struct faientry *entry;
+    struct seqtext seq;
+    size_t first, last;
+
+    if (reader->nextregion == reader->regioncount)
+        return -1;
+    region = &reader->regions[reader->nextregion++];
+    entry = find_fai_entry(reader, region->name);
+
+    snprintf(pseq->name, MAXSEQNAMELEN, "%s:%u-%u", region->name, region->start, region->end);
+    pseq->offset = region->start - 1;
+
+    first = fai_offset(entry, region->start - 1);
+    last = fai_offset(entry, region->end - 1) + 1;
+    if (last > reader->mapsize) {
+        PrintError("FASTA index does not match the input file");
+        return -1;
+    }
+
+    memset(&seq, 0, sizeof seq);
+    if (append_letters(&seq, reader->map + first, last - first) < 0) {
+        free(seq.text);
+        return -1;
+    }
+    if (seq.length != region->end - region->start + 1) {
+        PrintError("FASTA index does not match the input file");
+        free(seq.text);
+        return -1;
+    }
+
+    store_sequence(&seq, pseq);
+    return reader->nextregion < reader->regioncount;
+}
+
+/* Reports compressed input that could not be inflated. Returns -1. */
+static int corrupt_error(void)
+{
+    PrintError("Compressed input is corrupt or truncated");
+    return -1;
+}
+
+/* Reads the '>' or '@' line into pseq->name and empties pseq. Returns 1
+ * for a FASTQ record, 0 for a FASTA record, or -1. */
+static int read_header(struct seqreader *reader, struct fastasequence *pseq)
+{
+    int i, c, fastq;
+
+    /* read the FASTA '>' or FASTQ '@' symbol */
+    c = read_byte(reader);
+    if (c != '>' && c != '@')
+        return reader->error ? corrupt_error() : -1;    /* invalid format */
+    fastq = (c == '@');
+
+    /* read name and description text */
+    for (i = 0; i < MAXSEQNAMELEN - 1; i++) {
+        c = read_byte(reader);
+        if (c == 10 || c == 13) {
+            break;
+        }
+        else if (c == EOF) {
+            if (reader->error)
+                return corrupt_error();
+            PrintError(fastq ? "FASTQ input terminated too early" : "FASTA input terminated too early");
+            return -1;
+        }
+        else {
+            pseq->name[i] = (char)c;
+        }
+    }
+    pseq->name[i] = '\0';
+
+    /* if line was not read completely flush the rest */
+    if (i == MAXSEQNAMELEN - 1) {
+        c = 0;
+        while (c != 13 && c != 10 && c != EOF)
+            c = read_byte(reader);
+    }
+
+    pseq->sequence = NULL;
+    pseq->length = 0;
+    for (i = 0; i < 26; i++)
+        pseq->composition[i] = 0;
+    pseq->nucleotides = 0;
+
+    /* a header running into the end of the input has no sequence */
+    if (c == EOF)
+        return reader->error ? corrupt_error() : -1;
+
+    return fastq;
+}
+
+/* Checks what load_fasta_text or load_fastq_text returned, and stores
+ * the text in pseq unless it failed. Returns next. */
+static int finish_text(struct seqreader *reader, struct seqtext *seq, struct fastasequence *pseq, int next)
+{
+    if (next >= 0 && reader->error)
+        next = corrupt_error();
+    if (next >= 0 && seq->text == NULL && append_letters(seq, NULL, 0) < 0)
+        next = -1;
+    if (next < 0) {
+        free(seq->text);
+        pseq->sequence = NULL;
+        return -1;
+    }
+
+    store_sequence(seq, pseq);
+    return next;
+}
+
+int LoadSequence(struct seqreader *reader, struct fastasequence *pseq)
+{
+    struct seqtext seq;
+    int fastq;
+    int next;                   /* whether a next sequence was encountered */
+
+    pseq->offset = 0;
+    if (reader->regions != NULL)
+        return load_region(reader, pseq);
+    if (reader->source == SEQREAD_TWOBIT)
+        return load_twobit(reader, pseq);
+
+    fastq = read_header(reader, pseq);
+    if (fastq < 0)
+        return -1;
+
+    memset(&seq, 0, sizeof seq);
+    if (fastq)
+        next = load_fastq_text(reader, &seq);
+    else
+        next = load_fasta_text(reader, &seq, SIZE_MAX);
+
+    return finish_text(reader, &seq, pseq, next);
+}
+
+int LoadSequenceWindow(struct seqreader *reader, struct fastasequence *pseq, size_t keep, size_t size)
+{
+    struct seqtext seq;
+    size_t k;
+    int fastq;
+
+    memset(&seq, 0, sizeof seq);
+
+    if (pseq->sequence == NULL) {
+        /* regions and .2bit records are loaded whole */
+        if (reader->regions != NULL || reader->source == SEQREAD_TWOBIT)
+            return LoadSequence(reader, pseq);
+
+        pseq->offset = 0;
+        fastq = read_header(reader, pseq);
+        if (fastq < 0)
+            return -1;
+
+        /* so are FASTQ reads, which are short */
+        if (fastq)
+            return finish_text(reader, &seq, pseq, load_fastq_text(reader, &seq));
+
+        seq.text = malloc(size + 1);
+        if (seq.text == NULL) {
+            PrintError("Insufficient memory");
+            return -1;
+        }
+    }
+    else {
+        /* slide the window, keeping its last keep letters */
+        seq.text = pseq->sequence;
+        memmove(seq.text, seq.text + pseq->length - keep, keep);
+        for (k = 0; k < keep; k++)
+            seq.counts[(unsigned char)seq.text[k]]++;
+        seq.length = keep;
+        pseq->offset += pseq->length - keep;
+    }
+    seq.size = size + 1;
+
+    return finish_text(reader, &seq, pseq, load_fasta_text(reader, &seq, size));
+}
+
+/* Parses a coordinate such as 1,000,000. Returns 0, or -1. */
+static int parse_position(const char *p, size_t n, unsigned int *value)
+{
+    unsigned long long v = 0;
+    size_t i, digits = 0;
+
+    for (i = 0; i < n; i++) {
+        if (p[i] >= '0' && p[i] <= '9') {
+            v = 10 * v + (unsigned long long)(p[i] - '0');
+            if (v > 0xFFFFFFFFULL)
+                return -1;
+            digits++;
+        }
+        else if (p[i] != ',') {
+            return -1;
+        }
+    }
+
+    *value = (unsigned int)v;
+    return digits > 0 ? 0 : -1;
+}
+
+static int add_region(struct seqregion **regions, int *count, const char *name, size_t namelength,
+    unsigned int start, unsigned int end)
+{
+    struct seqregion *ptemp, *region;
+
+    /* grow when the count reaches a power of 2 */
+    if ((*count & (*count - 1)) == 0) {
+        ptemp = realloc(*regions, max(2 * (size_t)*count, 16) * sizeof **regions);
+        if (ptemp == NULL)
+            return -1;
+        *regions = ptemp;
+    }
+
+    region = &(*regions)[*count];
+    region->name = malloc(namelength + 1);
+    if (region->name == NULL)
+        return -1;
+    memcpy(region->name, name, namelength);
+    region->name[namelength] = '\0';
+    region->start = start;
+    region->end = end;
+    (*count)++;
+    return 0;
+}
+
+int ParseSequenceRegion(const char *spec, struct seqregion **regions, int *count)
+{
+    const char *colon, *dash;
+    unsigned int start = 1, end = 0, first, last = 0;
+    size_t namelength;
+    int ranged = 0;
+
+    /* a name may itself contain ':', so only a valid range after the
+     * last one is taken as the range */
+    namelength = strlen(spec);
+    colon = strrchr(spec, ':');
+    if (colon != NULL) {
+        dash = strchr(colon, '-');
+        if (dash == NULL)
+            ranged = parse_position(colon + 1, strlen(colon + 1), &first) == 0;
+        else
+            ranged = parse_position(colon + 1, (size_t)(dash - colon - 1), &first) == 0
+                && parse_position(dash + 1, strlen(dash + 1), &last) == 0;
+
+        if (ranged) {
+            if (first == 0 || (dash != NULL && last < first))
+                return -1;
+            start = first;
+            end = last;
+            namelength = (size_t)(colon - spec);
+        }
+    }
+
+    if (namelength == 0)
+        return -1;
+    return add_region(regions, count, spec, namelength, start, end);
+}
+
+int ReadSequenceRegions(const char *bedfile, struct seqregion **regions, int *count)
+{
+    FILE *fp;
+    char *line = NULL, *name, *first, *last;
+    size_t size = 0;
+    unsigned int start, end;
+    int added = 0;
+
+    fp = fopen(bedfile, "r");
+    if (fp == NULL)
+        return -1;
+
+    while (getline(&line, &size, fp) != -1) {
+        name = strtok(line, " \t\r\n");
+        if (name == NULL || name[0] == '#' || strcmp(name, "track") == 0 || strcmp(name, "browser") == 0)
+            continue;
+
+        first = strtok(NULL, " \t\r\n");
+        last = strtok(NULL, " \t\r\n");
+        if (first == NULL || last == NULL
+        || parse_position(first, strlen(first), &start) < 0
+        || parse_position(last, strlen(last), &end) < 0
+        || end <= start
+        || add_region(regions, count, name, strlen(name), start + 1, end) < 0) {
+            added = -1;
+            break;
+        }
+        added++;
+    }
+
+    free(line);
+    fclose(fp);
+    return added;
+}
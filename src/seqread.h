@@ -0,0 +1,141 @@
+#ifndef TRF_SEQREAD_H
+#define TRF_SEQREAD_H
+
+/*
+Tandem Repeats Finder
+Copyright (C) 1999-2020 Gary Benson
+
+This file is part of the Tandem Repeats Finder (TRF) program.
+
+TRF is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+TRF is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public
+License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/****************************************************************
+ *
+ *   SEQREAD.H : Sequence input
+ *
+ *****************************************************************
+ *   Reads FASTA records from a file or stdin in large blocks. The
+ *   sequence text between two headers is found with memchr, and
+ *   letters are copied in upper case through a lookup table, so
+ *   there is no per-character call or branch on case. Everything
+ *   that is not a letter (line breaks, digits, spaces) is dropped.
+ *
+ *   FASTQ records, starting with '@', are read the same way. Their
+ *   quality lines are skipped, counting as many characters as the
+ *   sequence had, since a quality line may itself begin with '@'.
+ *
+ *   Regular files are memory mapped and scanned in place, so only
+ *   the compacted sequence is copied to the heap, and the file pages
+ *   are shared by every process reading the same file.
+ *
+ *   UCSC .2bit files are decoded directly from the mapped file, one
+ *   sequence per call, using the N-block table to restore the Ns.
+ *
+ *   A long FASTA record can also be read in overlapping windows, so
+ *   that only one window of it is in memory at a time.
+ *
+ *   With a .fai index (as written by samtools faidx), chosen regions
+ *   of a FASTA file are read straight from their offsets in the
+ *   mapped file, without parsing the sequences before them.
+ *
+ *   gzip input is recognized by its magic number and inflated on the
+ *   fly. BGZF files (as written by bgzip) consist of independent
+ *   blocks of at most 64 kB, so a mapped BGZF file is inflated a
+ *   batch of blocks at a time, spread over several threads.
+ *****************************************************************/
+
+#include <stdio.h>
+
+/* bytes read from the input at a time */
+#define SEQREADBLOCK (1024 * 1024)
+
+/* BGZF blocks inflated per batch, and most threads used for it */
+#define BGZFBATCH 256
+#define BGZFMAXTHREADS 16
+
+/* where the bytes in the buffer come from */
+#define SEQREAD_STREAM 0        /* read through zlib, compressed or not */
+#define SEQREAD_MAPPED 1        /* buffer is the mapped file itself */
+#define SEQREAD_GZIP 2          /* inflated from the mapped file */
+#define SEQREAD_BGZF 3          /* inflated in parallel from the mapped file */
+#define SEQREAD_TWOBIT 4        /* .2bit records decoded from the mapped file */
+
+struct fastasequence;
+struct faientry;
+
+/* a stretch of one sequence to load instead of the whole input */
+struct seqregion {
+    char *name;
+    unsigned int start, end;    /* 1-based, inclusive, end 0 for the rest */
+};
+
+struct seqreader {
+    FILE *fp;
+    int source;                 /* one of the SEQREAD_ values */
+    unsigned char *buffer;      /* input to be parsed */
+    size_t pos, end;            /* unread bytes are buffer[pos..end) */
+    unsigned char *map;         /* mapped file */
+    size_t mapsize, mappos;     /* mappos is the next byte to inflate */
+    void *stream;               /* gzFile or z_stream */
+    int threads;                /* for SEQREAD_BGZF */
+    int error;                  /* compressed input is corrupt */
+    int swapped;                /* .2bit file of the other byte order */
+    int wideoffsets;            /* .2bit version 1, with 64 bit offsets */
+    unsigned int records;       /* .2bit records not yet loaded */
+    struct faientry *fai;       /* .fai entries, sorted by name */
+    size_t faicount;
+    struct seqregion *regions;  /* regions to load, if any */
+    int regioncount, nextregion;
+};
+
+/* Starts reading fp, which is closed by CloseSequenceReader. Returns
+ * NULL if out of memory. */
+struct seqreader *OpenSequenceReader(FILE *fp);
+
+void CloseSequenceReader(struct seqreader *reader);
+
+/* Loads the next record into pseq, allocating pseq->sequence, which the
+ * caller must free. Returns 1 if another record follows, 0 at the end
+ * of the input, or -1 if the input is not FASTA, FASTQ or .2bit, is
+ * corrupt, or memory ran out. */
+int LoadSequence(struct seqreader *reader, struct fastasequence *pseq);
+
+/* Loads a long record a window of at most size letters at a time, each
+ * window starting keep letters before the end of the last. pseq->sequence
+ * must be NULL to start the next record, and is reused by the windows that
+ * follow; pseq->offset is the number of letters before the window. Only
+ * FASTA text is split; other records are loaded whole. Returns 2 if the
+ * record goes on, otherwise as LoadSequence. */
+int LoadSequenceWindow(struct seqreader *reader, struct fastasequence *pseq, size_t keep, size_t size);
+
+/* Makes LoadSequence load only the given regions, in order, from their
+ * offsets in the .fai index file indexpath. The input must be a mapped,
+ * uncompressed FASTA file. An end of 0 or past the end of the sequence
+ * is set to its length. Returns 0, or -1 if the index cannot be read or
+ * a region is not in it. */
+int SetSequenceRegions(struct seqreader *reader, const char *indexpath,
+    struct seqregion *regions, int count);
+
+/* Adds the region given as name, name:start or name:start-end, 1-based
+ * and inclusive, to *regions. Numbers may contain commas. Returns 0, or
+ * -1 if spec is malformed or memory ran out. */
+int ParseSequenceRegion(const char *spec, struct seqregion **regions, int *count);
+
+/* Adds the intervals of a BED file, which are 0-based and half open.
+ * Returns the number added, or -1 if the file cannot be read or a line
+ * is malformed. */
+int ReadSequenceRegions(const char *bedfile, struct seqregion **regions, int *count);
+
+#endif
@@ -27,6 +27,8 @@ License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
 #include "tr30dat.h"
 #include "indexlist.h"
 #include "trfrun.h"
+#include "tuplestats.h"
+#include "trfclean.h"
 
 struct distanceentry *_DistanceEntries;
 
@@ -103,6 +105,9 @@ void init_index(void)
     Index['C'] = 1;
     Index['G'] = 2;
     Index['T'] = 3;
+
+    Validbase['A'] = Validbase['C'] = Validbase['G'] = Validbase['T'] = 1;
+    Validbase['a'] = Validbase['c'] = Validbase['g'] = Validbase['t'] = 1;
 }
 
 /* *pcurr>=maxscore added 2.17.05 gary benson -- to extend alignment as far as possible */
@@ -486,11 +491,69 @@ void narrowbandwrap(int start, int size, int bandradius, int bandradiusforward,
     }
 }
 
+static int periodic_extent(int x, int d, int step, int limit);
+
+/* Perfect periodic runs. Where each base equals the one size positions
+ * back, the scan passes of newwrap repeat the same row updates every
+ * size rows with all scores raised by size*Alpha, as long as every score
+ * stays above -Delta so that the clamp at 0 never applies. Once the last
+ * size+1 rows show this, whole periods are skipped by adding to the
+ * scores instead of filling rows. */
+
+/* TRUE if rows r, r+prev, ..., r+prev*size of S are in that regime, prev
+ * being the direction of the rows filled before r */
+static int wrap_rows_periodic(int r, int prev, int size)
+{
+    int c, k;
+
+    for (c = 0; c < size; c++)
+        if (S[r][c] - S[r + prev * size][c] != size * Alpha)
+            return FALSE;
+
+    for (k = 0; k <= size; k++)
+        for (c = 0; c < size; c++)
+            if (S[r + prev * k][c] <= -Delta)
+                return FALSE;
+
+    return TRUE;
+}
+
+/* Raises the scan state at row r of S by the given number of periods and
+ * stores it in the row reached. Returns the best score of the last
+ * skipped period in best, and in offset how many rows before the one
+ * reached the last row with that score is. */
+static void wrap_skip_periods(int r, int prev, int size, int periods, int *best, int *offset)
+{
+    int c, u, rowmax, raise, target;
+
+    *best = -1;
+    *offset = 0;
+    for (u = 0; u < size; u++) {
+        rowmax = S[r + prev * u][0];
+        for (c = 1; c < size; c++)
+            rowmax = max(rowmax, S[r + prev * u][c]);
+        if (rowmax > *best) {
+            *best = rowmax;
+            *offset = u;
+        }
+    }
+
+    raise = periods * size * Alpha;
+    *best += raise;
+    target = r - prev * periods * size;
+    for (c = 0; c < size; c++) {
+        S[target][c] = S[r][c] + raise;
+        Diag[c] += raise;
+        Up[c] += raise;
+    }
+}
+
 void newwrap(int start, int size, int consensuspresent)
 {
     int g;
     int *pup, *pdiag, *pcurr, pleft;
     int adjlength, adjmone, c, realr, end_of_trace, maxscore, minrow = 0, maxrow = 0, maxcol = 0, modstart, maxrealrow = 0;
+    int passrows, retry, periods, best, offset;
     char currchar;
 
     /* Feb 16, 2016 Yozen */
@@ -524,6 +587,7 @@ void newwrap(int start, int size, int consensuspresent)
 
     /* backwards */
     end_of_trace = FALSE;
+    passrows = retry = 0;
     while (!end_of_trace && realr > 1 && r > 0) {
         r--;
         realr--;
@@ -576,6 +640,24 @@ void newwrap(int start, int size, int consensuspresent)
         }
 
         Diag[adjlength] = *pcurr;
+
+        /* skip whole periods of a perfect run */
+        if (++passrows > size && passrows >= retry && !end_of_trace) {
+            periods = periodic_extent(realr - 1 + size, size, -1, min((int)r, realr - 1)) / size;
+            if (periods > 0 && wrap_rows_periodic(r, 1, size)) {
+                wrap_skip_periods(r, 1, size, periods, &best, &offset);
+                r -= periods * size;
+                realr -= periods * size;
+                Rows += periods * size;
+                passrows = 1;
+                if (best >= maxscore) {
+                    maxscore = best;
+                    minrow = realr + offset;
+                }
+            }
+            else
+                retry = passrows + size;
+        }
     }
 
     r = 0;
@@ -595,6 +677,7 @@ void newwrap(int start, int size, int consensuspresent)
     }
 
     end_of_trace = FALSE;
+    passrows = retry = 0;
     while (!end_of_trace && realr < Length && r < maxwraplength) {
         r++;
         realr++;
@@ -649,6 +732,23 @@ void newwrap(int start, int size, int consensuspresent)
         }
         Diag[0] = Diag[size];
 
+        /* skip whole periods of a perfect run */
+        if (++passrows > size && passrows >= retry && !end_of_trace) {
+            periods = periodic_extent(realr + 1, size, 1, min((int)(maxwraplength - r), Length - realr)) / size;
+            if (periods > 0 && wrap_rows_periodic(r, -1, size)) {
+                wrap_skip_periods(r, -1, size, periods, &best, &offset);
+                r += periods * size;
+                realr += periods * size;
+                Rows += periods * size;
+                passrows = 1;
+                if (best >= maxscore) {
+                    maxscore = best;
+                    maxrow = realr - offset;
+                }
+            }
+            else
+                retry = passrows + size;
+        }
     }
 
     /* store last position scanned with this pattern */
@@ -754,19 +854,58 @@ void newwrap(int start, int size, int consensuspresent)
 
 void init_bestperiodlist(void)
 {
-    Bestperiodlist->next = NULL;
+    Bestperiodcount = 0;
+    Bestperiodnewest = -1;
 }
 
 void free_bestperiodlist(void)
 {
-    struct bestperiodlistelement *entry, *entrylast;
+    free(Bestperiodlist);
+    Bestperiodlist = NULL;
+    Bestperiodcount = Bestperiodsize = 0;
+    Bestperiodnewest = -1;
+}
 
-    entry = Bestperiodlist->next;
-    Bestperiodlist->next = NULL;
-    while (entry != NULL) {
-        entrylast = entry;
-        entry = entry->next;
-        free(entrylast);
+/* exchanges two heap slots, following the newest entry */
+static void swap_bestperiod_entries(int a, int b)
+{
+    struct bestperiodlistelement temp;
+
+    temp = Bestperiodlist[a];
+    Bestperiodlist[a] = Bestperiodlist[b];
+    Bestperiodlist[b] = temp;
+
+    if (Bestperiodnewest == a)
+        Bestperiodnewest = b;
+    else if (Bestperiodnewest == b)
+        Bestperiodnewest = a;
+}
+
+static void sift_up_bestperiod_entry(int slot)
+{
+    int parent;
+
+    while (slot > 0) {
+        parent = (slot - 1) / 2;
+        if (Bestperiodlist[parent].indexhigh <= Bestperiodlist[slot].indexhigh)
+            break;
+        swap_bestperiod_entries(parent, slot);
+        slot = parent;
+    }
+}
+
+static void sift_down_bestperiod_entry(int slot)
+{
+    int child;
+
+    while ((child = 2 * slot + 1) < Bestperiodcount) {
+        if (child + 1 < Bestperiodcount
+        && Bestperiodlist[child + 1].indexhigh < Bestperiodlist[child].indexhigh)
+            child++;
+        if (Bestperiodlist[slot].indexhigh <= Bestperiodlist[child].indexhigh)
+            break;
+        swap_bestperiod_entries(slot, child);
+        slot = child;
     }
 }
 
@@ -774,15 +913,22 @@ void free_bestperiodlist(void)
  * to change in multiples_criteria_4 */
 void add_to_bestperiodlist(int d)
 {
+    struct bestperiodlistelement *ptr, *grown;
+
     if (d == 1)
         return;
 
-    struct bestperiodlistelement *ptr = calloc(1, sizeof *ptr);
-    if (ptr == NULL) {
-        trf_message("\nAdd_to_bestperiodlist: Out of memory!");
-        exit(-1);
+    if (Bestperiodcount == Bestperiodsize) {
+        grown = realloc(Bestperiodlist, 2 * (Bestperiodsize + 8) * sizeof *Bestperiodlist);
+        if (grown == NULL) {
+            trf_message("\nAdd_to_bestperiodlist: Out of memory!");
+            exit(-1);
+        }
+        Bestperiodlist = grown;
+        Bestperiodsize = 2 * (Bestperiodsize + 8);
     }
 
+    ptr = &Bestperiodlist[Bestperiodcount];
     ptr->indexlow = AlignPair.indexprime[AlignPair.length];
     ptr->indexhigh = AlignPair.indexprime[1];
 
@@ -791,8 +937,9 @@ void add_to_bestperiodlist(int d)
     ptr->best3 = Sortmultiples[2];
     ptr->best4 = Sortmultiples[3];
     ptr->best5 = Sortmultiples[4];
-    ptr->next = Bestperiodlist->next;
-    Bestperiodlist->next = ptr;
+
+    Bestperiodnewest = Bestperiodcount++;
+    sift_up_bestperiod_entry(Bestperiodnewest);
 }
 
 /* shortens length of best period entry if the consensus alignment
@@ -804,10 +951,12 @@ void adjust_bestperiod_entry(int d)
 
     /* when distance is 1, no Sortmultiples are defined due 
      * to change in multiples_criteria_4 */
-    if (d != 1) {
-        ptr = Bestperiodlist->next;
-        if (ptr->indexhigh > AlignPair.indexprime[1])
+    if (d != 1 && Bestperiodnewest >= 0) {
+        ptr = &Bestperiodlist[Bestperiodnewest];
+        if (ptr->indexhigh > AlignPair.indexprime[1]) {
             ptr->indexhigh = AlignPair.indexprime[1];
+            sift_up_bestperiod_entry(Bestperiodnewest);
+        }
     }
 }
 
@@ -820,39 +969,37 @@ void adjust_bestperiod_entry(int d)
  * returns false otherwise */
 int search_for_range_in_bestperiodlist(int start, int distance)
 {
-    struct bestperiodlistelement *entry, *entrylast, *temp;
-    int range_covered;
-
-    entry = Bestperiodlist->next;
-    entrylast = Bestperiodlist;
-    range_covered = FALSE;
-    while (entry != NULL) {
-        if (entry->indexhigh < start - 2 * g_MAXDISTANCE) {
-            /* remove current entry, too far back */
-
-            entrylast->next = entry->next;
-            temp = entry;
-            entry = entrylast;
-            free(temp);
+    struct bestperiodlistelement *entry;
+    int range_covered, e;
+
+    /* remove entries too far back, smallest indexhigh first */
+    while (Bestperiodcount > 0 && Bestperiodlist[0].indexhigh < start - 2 * g_MAXDISTANCE) {
+        if (Bestperiodnewest == 0)
+            Bestperiodnewest = -1;
+        Bestperiodcount--;
+        if (Bestperiodcount > 0) {
+            swap_bestperiod_entries(0, Bestperiodcount);
+            sift_down_bestperiod_entry(0);
         }
-        else {
-            /* this specifies how much must be bracketed */
-            if (entry->indexlow <= start - 2 * distance + 1 + Distance[distance].waiting_time_criteria
-            && entry->indexhigh >= start) {
-                range_covered = TRUE;
+    }
 
-                if (entry->best1 == distance
-                || entry->best2 == distance
-                || entry->best3 == distance
-                || entry->best4 == distance
-                || entry->best5 == distance)
-                    return TRUE;
-            }
+    /* the outcome does not depend on the order entries are tested in */
+    range_covered = FALSE;
+    for (e = 0; e < Bestperiodcount; e++) {
+        entry = &Bestperiodlist[e];
+
+        /* this specifies how much must be bracketed */
+        if (entry->indexlow <= start - 2 * distance + 1 + Distance[distance].waiting_time_criteria
+        && entry->indexhigh >= start) {
+            range_covered = TRUE;
+
+            if (entry->best1 == distance
+            || entry->best2 == distance
+            || entry->best3 == distance
+            || entry->best4 == distance
+            || entry->best5 == distance)
+                return TRUE;
         }
-
-        /* go to next entry */
-        entrylast = entry;
-        entry = entry->next;
     }
     if (!range_covered)
         return TRUE;
@@ -1361,16 +1508,13 @@ void shift_pattern_indices(int patternsize)
     }
 }
 
-/* change added to make indices run
- * from 1 to patternsize in the output */
-/* prints out the alignment in AlignPair */
+/* prints out the alignment in AlignPair, whose pattern indices
+ * shift_pattern_indices has already made run from 0 */
 void alt3_print_alignment(int patternwidth)
 {
     extern int pwidth;
     int i, j, g, h, first, m;
 
-    shift_pattern_indices(patternwidth);
-
     if (pwidth > 0) {
         if (AlignPair.indexprime[1] != 1) {
             m = AlignPair.indexprime[1] - 10;
@@ -1378,7 +1522,7 @@ void alt3_print_alignment(int patternwidth)
                 m = 1;
 
             j = m;
-            fprintf(Fptxt, "  %9d ", j);
+            fprintf(Fptxt, "  %9d ", j + Sequenceoffset);
             for (i = 1; i <= 10; i++) {
                 fputc(Sequence[j], Fptxt);
                 j++;
@@ -1423,7 +1567,7 @@ void alt3_print_alignment(int patternwidth)
 
             fputc('\n', Fptxt);
             j = g;
-            fprintf(Fptxt, "  %9d ", AlignPair.indexprime[j]);
+            fprintf(Fptxt, "  %9d ", AlignPair.indexprime[j] + Sequenceoffset);
             first = TRUE;
             h = 0;
 
@@ -1482,7 +1626,7 @@ void alt3_print_alignment(int patternwidth)
             if (m > Length)
                 m = Length;
             j = AlignPair.indexprime[AlignPair.length] + 1;
-            fprintf(Fptxt, "  %9d ", j);
+            fprintf(Fptxt, "  %9d ", j + Sequenceoffset);
 
             for (i = 1; i <= 10; i++) {
                 fputc(Sequence[j], Fptxt);
@@ -1498,46 +1642,42 @@ void alt3_print_alignment(int patternwidth)
         fprintf(Fptxt, "Error, pwidth<=0, can't report alignments.\n");
 }
 
-void print_alignment_headings(int consensuslength)
+void print_alignment_headings(const struct index_list *entry)
 {
+    const struct alignrecord *record = entry->il_record;
+
     /* headings */
     if (Heading == 0)
         Heading = 1;
 
     fprintf(Fptxt, "\n\n<A NAME=\"%d--%d,%d,%3.1f,%d,%d\">",
-        AlignPair.indexprime[1],
-        AlignPair.indexprime[AlignPair.length], Period, Copynumber, consensuslength, (int)OUTPUTcount);
+        AlignPair.indexprime[1] + Sequenceoffset,
+        AlignPair.indexprime[AlignPair.length] + Sequenceoffset, entry->il_period, record->copynumber,
+        entry->il_size, record->outputcount);
     fprintf(Fptxt, "</A>");
 
     fprintf(Fptxt,
         "<A HREF=\"http://tandem.bu.edu/trf/trf.definitions.html#alignment\" target =\"explanation\">Alignment explanation</A><BR><BR>\n");
 
-    fprintf(Fptxt, "    Indices: %d--%d", AlignPair.indexprime[1], AlignPair.indexprime[AlignPair.length]);
-    fprintf(Fptxt, "  Score: %d", Maxscore);
+    fprintf(Fptxt, "    Indices: %d--%d", AlignPair.indexprime[1] + Sequenceoffset,
+        AlignPair.indexprime[AlignPair.length] + Sequenceoffset);
+    fprintf(Fptxt, "  Score: %d", record->score);
     fprintf(Fptxt, "\n    Period size: %d  Copynumber: %3.1f  Consensus size: %d\n\n",
-        Period, Copynumber, consensuslength);
+        entry->il_period, record->copynumber, entry->il_size);
 }
 
 #if WEIGHTCONSENSUS
 
 void get_consensus(int patternsize)
 {
-    int c, lastindex, j, i, max, letters, newinsert, insertA, insertC, insertG, insertT;
+    int lastindex, j, i, max, letters, newinsert, insertA, insertC, insertG, insertT;
     char maxchar;
 
     /* initialize counts */
 
-    for (c = 0; c <= 2 * (MAXPATTERNSIZE); c++) {
-        Consensus.A[c] = 0;
-        Consensus.C[c] = 0;
-        Consensus.G[c] = 0;
-        Consensus.T[c] = 0;
-        Consensus.dash[c] = 0;
-        Consensus.insert[c] = 0;    /* times insert occurs */
-        Consensus.letters[c] = 0;   /* number of letters in all inserts */
-        Consensus.total[c] = 0; /* occurrences of a position */
-        Consensus.pattern[c] = DASH;
-    }
+    /* only positions 0..2*patternsize are used */
+    memset(Consensus.count, 0, (2 * patternsize + 1) * sizeof *Consensus.count);
+    memset(Consensus.pattern, DASH, 2 * patternsize + 1);
 
     /* start consensus */
 
@@ -1548,28 +1688,28 @@ void get_consensus(int patternsize)
         if (AlignPair.indexsecnd[i] != lastindex) {
             switch (AlignPair.textprime[i]) {
                 case 'A':
-                    Consensus.A[2 * AlignPair.indexsecnd[i] + 1]++;
+                    Consensus.count[2 * AlignPair.indexsecnd[i] + 1].A++;
                     break;
                 case 'C':
-                    Consensus.C[2 * AlignPair.indexsecnd[i] + 1]++;
+                    Consensus.count[2 * AlignPair.indexsecnd[i] + 1].C++;
                     break;
                 case 'G':
-                    Consensus.G[2 * AlignPair.indexsecnd[i] + 1]++;
+                    Consensus.count[2 * AlignPair.indexsecnd[i] + 1].G++;
                     break;
                 case 'T':
-                    Consensus.T[2 * AlignPair.indexsecnd[i] + 1]++;
+                    Consensus.count[2 * AlignPair.indexsecnd[i] + 1].T++;
                     break;
                 case DASH:
-                    Consensus.dash[2 * AlignPair.indexsecnd[i] + 1]++;
+                    Consensus.count[2 * AlignPair.indexsecnd[i] + 1].dash++;
                     break;
             }
-            Consensus.total[2 * AlignPair.indexsecnd[i] + 1]++;
+            Consensus.count[2 * AlignPair.indexsecnd[i] + 1].total++;
             if (lastindex != -1) {
                 if (AlignPair.indexsecnd[i] == patternsize - 1) {
-                    Consensus.total[0]++;
+                    Consensus.count[0].total++;
                 }
                 else {
-                    Consensus.total[2 * AlignPair.indexsecnd[i] + 2]++;
+                    Consensus.count[2 * AlignPair.indexsecnd[i] + 2].total++;
                 }
             }
             lastindex = AlignPair.indexsecnd[i];
@@ -1577,7 +1717,7 @@ void get_consensus(int patternsize)
 
         }
         else {                  /* AlignPair.indexsecnd[i]==lastindex */
-            Consensus.insert[2 * AlignPair.indexsecnd[i]]++;
+            Consensus.count[2 * AlignPair.indexsecnd[i]].insert++;
             insertA = 0;
             insertC = 0;
             insertG = 0;
@@ -1588,31 +1728,31 @@ void get_consensus(int patternsize)
                 switch (AlignPair.textprime[i]) {
                     case 'A':
                         if (insertA == 0) {
-                            Consensus.A[2 * AlignPair.indexsecnd[i]]++;
+                            Consensus.count[2 * AlignPair.indexsecnd[i]].A++;
                             insertA = 1;
                             break;
                         }
                     case 'C':
                         if (insertC == 0) {
-                            Consensus.C[2 * AlignPair.indexsecnd[i]]++;
+                            Consensus.count[2 * AlignPair.indexsecnd[i]].C++;
                             insertC = 1;
                             break;
                         }
                     case 'G':
                         if (insertG == 0) {
-                            Consensus.G[2 * AlignPair.indexsecnd[i]]++;
+                            Consensus.count[2 * AlignPair.indexsecnd[i]].G++;
                             insertG = 1;
                             break;
                         }
                     case 'T':
                         if (insertT == 0) {
-                            Consensus.T[2 * AlignPair.indexsecnd[i]]++;
+                            Consensus.count[2 * AlignPair.indexsecnd[i]].T++;
                             insertT = 1;
                             break;
                         }
                 }
 
-                Consensus.letters[2 * AlignPair.indexsecnd[i]]++;
+                Consensus.count[2 * AlignPair.indexsecnd[i]].letters++;
                 i++;
             }
         }
@@ -1620,24 +1760,24 @@ void get_consensus(int patternsize)
 
     /* get consensus for letters that exist */
     for (i = 1; i <= 2 * (patternlength); i += 2) {
-        letters = Consensus.total[i] - Consensus.dash[i];
-        max = Consensus.A[i];
+        letters = Consensus.count[i].total - Consensus.count[i].dash;
+        max = Consensus.count[i].A;
         maxchar = 'A';
-        if (max < Consensus.C[i]) {
-            max = Consensus.C[i];
+        if (max < Consensus.count[i].C) {
+            max = Consensus.count[i].C;
             maxchar = 'C';
         }
-        if (max < Consensus.G[i]) {
-            max = Consensus.G[i];
+        if (max < Consensus.count[i].G) {
+            max = Consensus.count[i].G;
             maxchar = 'G';
         }
-        if (max < Consensus.T[i]) {
-            max = Consensus.T[i];
+        if (max < Consensus.count[i].T) {
+            max = Consensus.count[i].T;
             maxchar = 'T';
         }
 
         /* weighted consensus */
-        if (((max * Alpha) + ((letters - max) * Beta) + (Consensus.dash[i] * Delta))
+        if (((max * Alpha) + ((letters - max) * Beta) + (Consensus.count[i].dash * Delta))
             >= (letters * Delta))
             Consensus.pattern[i] = maxchar;
         else
@@ -1647,29 +1787,29 @@ void get_consensus(int patternsize)
 
     /* get consensus for inserted letters */
     for (i = 0; i <= 2 * (patternlength); i += 2) {
-        if (Consensus.total[i] != 0) {
-            max = Consensus.A[i];
+        if (Consensus.count[i].total != 0) {
+            max = Consensus.count[i].A;
             maxchar = 'A';
 
-            if (max < Consensus.C[i]) {
-                max = Consensus.C[i];
+            if (max < Consensus.count[i].C) {
+                max = Consensus.count[i].C;
                 maxchar = 'C';
             }
 
-            if (max < Consensus.G[i]) {
-                max = Consensus.G[i];
+            if (max < Consensus.count[i].G) {
+                max = Consensus.count[i].G;
                 maxchar = 'G';
             }
 
-            if (max < Consensus.T[i]) {
-                max = Consensus.T[i];
+            if (max < Consensus.count[i].T) {
+                max = Consensus.count[i].T;
                 maxchar = 'T';
             }
 
             if (((max * Alpha) 
-            + ((Consensus.insert[i] - max) * Beta)
-            + ((Consensus.letters[i] - Consensus.insert[i]) * Delta) 
-            + ((Consensus.total[i] - Consensus.insert[i]) * Delta)) > (Consensus.letters[i] * Delta))
+            + ((Consensus.count[i].insert - max) * Beta)
+            + ((Consensus.count[i].letters - Consensus.count[i].insert) * Delta) 
+            + ((Consensus.count[i].total - Consensus.count[i].insert) * Delta)) > (Consensus.count[i].letters * Delta))
                 Consensus.pattern[i] = maxchar;
             else
                 Consensus.pattern[i] = DASH;
@@ -1692,26 +1832,14 @@ void get_consensus(int patternsize)
 
 void get_consensus(int patternlength)
 {
-    int c, lastindex, j, i, max;
+    int lastindex, j, i, max;
     char maxchar;
 
     /* initialize counts */
 
-    /* Y. Hernandez Oct 15, 2018 */
-    /* Changed from MAXPATTERNSIZE to MAXPATTERNSIZECONSTANT since that
-     * is what is used to init the arrays in Consensus. Using
-     * MAXPATTERNSIZE will result in an out-of-bounds error if > 2000.
-     */
-    for (c = 0; c <= 2 * (MAXPATTERNSIZECONSTANT); c++) {
-        Consensus.A[c] = 0;
-        Consensus.C[c] = 0;
-        Consensus.G[c] = 0;
-        Consensus.T[c] = 0;
-        Consensus.dash[c] = 0;
-        Consensus.insert[c] = 0;
-        Consensus.total[c] = 0;
-        Consensus.pattern[c] = DASH;
-    }
+    /* Only positions 0..2*patternlength are used, so only those are
+     * cleared; every pattern position in that range is set below. */
+    memset(Consensus.count, 0, (2 * patternlength + 1) * sizeof *Consensus.count);
 
     /* start consensus */
 
@@ -1722,31 +1850,31 @@ void get_consensus(int patternlength)
         if (AlignPair.indexsecnd[i] != lastindex) {
             switch (AlignPair.textprime[i]) {
                 case 'A':
-                    Consensus.A[2 * AlignPair.indexsecnd[i] + 1]++;
+                    Consensus.count[2 * AlignPair.indexsecnd[i] + 1].A++;
                     break;
 
                 case 'C':
-                    Consensus.C[2 * AlignPair.indexsecnd[i] + 1]++;
+                    Consensus.count[2 * AlignPair.indexsecnd[i] + 1].C++;
                     break;
 
                 case 'G':
-                    Consensus.G[2 * AlignPair.indexsecnd[i] + 1]++;
+                    Consensus.count[2 * AlignPair.indexsecnd[i] + 1].G++;
                     break;
 
                 case 'T':
-                    Consensus.T[2 * AlignPair.indexsecnd[i] + 1]++;
+                    Consensus.count[2 * AlignPair.indexsecnd[i] + 1].T++;
                     break;
 
                 case DASH:
-                    Consensus.dash[2 * AlignPair.indexsecnd[i] + 1]++;
+                    Consensus.count[2 * AlignPair.indexsecnd[i] + 1].dash++;
                     break;
             }
 
             if (lastindex != -1) {
                 if (AlignPair.indexsecnd[i] == patternlength - 1)
-                    Consensus.total[0]++;
+                    Consensus.count[0].total++;
                 else
-                    Consensus.total[2 * AlignPair.indexsecnd[i] + 2]++;
+                    Consensus.count[2 * AlignPair.indexsecnd[i] + 2].total++;
             }
 
             lastindex = AlignPair.indexsecnd[i];
@@ -1754,30 +1882,30 @@ void get_consensus(int patternlength)
 
         }
         else {                  /* AlignPair.indexsecnd[i]==lastindex */
-            Consensus.insert[2 * AlignPair.indexsecnd[i]]++;
+            Consensus.count[2 * AlignPair.indexsecnd[i]].insert++;
 
             while ((AlignPair.indexsecnd[i] == lastindex)
                 && (i <= AlignPair.length)) {
 
                 switch (AlignPair.textprime[i]) {
                     case 'A':
-                        Consensus.A[2 * AlignPair.indexsecnd[i]]++;
+                        Consensus.count[2 * AlignPair.indexsecnd[i]].A++;
                         break;
 
                     case 'C':
-                        Consensus.C[2 * AlignPair.indexsecnd[i]]++;
+                        Consensus.count[2 * AlignPair.indexsecnd[i]].C++;
                         break;
 
                     case 'G':
-                        Consensus.G[2 * AlignPair.indexsecnd[i]]++;
+                        Consensus.count[2 * AlignPair.indexsecnd[i]].G++;
                         break;
 
                     case 'T':
-                        Consensus.T[2 * AlignPair.indexsecnd[i]]++;
+                        Consensus.count[2 * AlignPair.indexsecnd[i]].T++;
                         break;
 
                     case DASH:
-                        Consensus.dash[2 * AlignPair.indexsecnd[i]]++;
+                        Consensus.count[2 * AlignPair.indexsecnd[i]].dash++;
                         break;
                 }
 
@@ -1787,26 +1915,26 @@ void get_consensus(int patternlength)
     }
 
     for (i = 1; i <= 2 * (patternlength); i += 2) {
-        max = Consensus.dash[i];
+        max = Consensus.count[i].dash;
         maxchar = DASH;
 
-        if (max < Consensus.A[i]) {
-            max = Consensus.A[i];
+        if (max < Consensus.count[i].A) {
+            max = Consensus.count[i].A;
             maxchar = 'A';
         }
 
-        if (max < Consensus.C[i]) {
-            max = Consensus.C[i];
+        if (max < Consensus.count[i].C) {
+            max = Consensus.count[i].C;
             maxchar = 'C';
         }
 
-        if (max < Consensus.G[i]) {
-            max = Consensus.G[i];
+        if (max < Consensus.count[i].G) {
+            max = Consensus.count[i].G;
             maxchar = 'G';
         }
 
-        if (max < Consensus.T[i]) {
-            max = Consensus.T[i];
+        if (max < Consensus.count[i].T) {
+            max = Consensus.count[i].T;
             maxchar = 'T';
         }
 
@@ -1814,23 +1942,23 @@ void get_consensus(int patternlength)
     }
 
     for (i = 0; i <= 2 * (patternlength); i += 2) {
-        if (Consensus.total[i] != 0
-        && (float)Consensus.insert[i] / Consensus.total[i] >= 0.5) {
-            max = Consensus.A[i];
+        if (Consensus.count[i].total != 0
+        && (float)Consensus.count[i].insert / Consensus.count[i].total >= 0.5) {
+            max = Consensus.count[i].A;
             maxchar = 'A';
 
-            if (max < Consensus.C[i]) {
-                max = Consensus.C[i];
+            if (max < Consensus.count[i].C) {
+                max = Consensus.count[i].C;
                 maxchar = 'C';
             }
 
-            if (max < Consensus.G[i]) {
-                max = Consensus.G[i];
+            if (max < Consensus.count[i].G) {
+                max = Consensus.count[i].G;
                 maxchar = 'G';
             }
 
-            if (max < Consensus.T[i]) {
-                max = Consensus.T[i];
+            if (max < Consensus.count[i].T) {
+                max = Consensus.count[i].T;
                 maxchar = 'T';
             }
         }
@@ -2047,83 +2175,206 @@ int no_matches_so_unlink_Distance(int d, int location, struct distancelist *objp
     return 0;
 }
 
+/* Grows a scratch buffer kept between calls to hold at least needed
+ * elements. Returns the buffer, or NULL if it could not be grown. */
+static void *grow_scratch(void *buffer, int *size, int needed, size_t elsize)
+{
+    int newsize;
+
+    if (needed <= *size)
+        return buffer;
+
+    newsize = 2 * (*size);
+    if (newsize < needed)
+        newsize = needed;
+    buffer = realloc(buffer, newsize * elsize);
+    if (buffer != NULL)
+        *size = newsize;
+    return buffer;
+}
+
+/* number of set bits */
+static inline int count_bits(unsigned long long bits)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(bits);
+#else
+    int n = 0;
+
+    for (; bits; bits &= bits - 1)
+        n++;
+    return n;
+#endif
+}
+
+/* Low bit of each two bit lane of word w of the packed pattern set where
+ * the base equals the one q words and r bits back. packed[0] is padding. */
+static inline unsigned long long packed_equal(unsigned long long *packed, int w, int q, int r)
+{
+    unsigned long long back, x;
+
+    back = packed[w + 1 - q] << r;
+    if (r)
+        back |= packed[w - q] >> (64 - r);
+    x = packed[w + 1] ^ back;
+    return ~(x | (x >> 1)) & 0x5555555555555555ULL;
+}
+
+/* Counts, for d in 1..maxd, the positions i in d..length-2 whose
+ * dinucleotide equals the one at i-d, by comparing the packed pattern
+ * with itself shifted by d. */
+static void count_dinucleotide_matches(unsigned long long *packed, int length, int maxd, double *counts)
+{
+    unsigned long long eq, next, pair;
+    int d, w, q, r, last, total;
+
+    last = length - 2;
+    for (d = 1; d <= maxd; d++) {
+        q = d / 32;
+        r = 2 * (d % 32);
+        total = 0;
+        eq = packed_equal(packed, q, q, r);
+        for (w = q; w <= last / 32; w++) {
+            next = packed_equal(packed, w + 1, q, r);
+            pair = eq & ((eq >> 2) | (next << 62));
+            if (w == q)
+                pair &= ~0ULL << r;
+            if (w == last / 32)
+                pair &= ~0ULL >> (62 - 2 * (last % 32));
+            total += count_bits(pair);
+            eq = next;
+        }
+        counts[d] = total;
+    }
+}
+
 int GetTopPeriods(unsigned char *pattern, int length, int *toparray)
 {
+    /* scratch buffers, kept between calls */
+    static double *counts = NULL;
+    static int *positions = NULL;
+    static unsigned long long *packed = NULL;
+    static int countssize = 0, positionssize = 0, packedsize = 0;
+
     int topind;
     double topval;
-    int heads[16];
-    int *history;
-    double *counts;
-    int i, t, end, tupid;
-    int curr, dist;
+    int starts[17];
+    int i, j, k, t, end, maxd, tupid, far, near, words;
+    long long pairs, distsum, windowsum, nearpairs;
     double n, xysum, xsum, ysum, x2sum, s;
+    void *p;
 
-    /* allocate an array of counts */
-    counts = calloc(length, sizeof *counts);
-    if (counts == NULL)
+    /* only distances up to maxd are candidates */
+    end = length - 2;
+    maxd = end;
+    if (maxd > g_MAXDISTANCE)
+        maxd = g_MAXDISTANCE;      /* 3/14/05 accepts smaller multiples is best ones are too large */
+    if (maxd < 0)
+        maxd = 0;
+
+    p = grow_scratch(counts, &countssize, maxd + 1, sizeof *counts);
+    if (p == NULL)
         return 1;
-
-    /* allocate history array */
-    history = malloc(length * sizeof *history);
-    if (history == NULL) {
-        free(counts);
+    counts = p;
+    p = grow_scratch(positions, &positionssize, length, sizeof *positions);
+    if (p == NULL)
         return 1;
-    }
-
-    /* clear the heads array which point into history array */
-    for (i = 0; i < 16; i++)
-        heads[i] = -1;
-
-    /* scan pattern for tuples of size 2 */
-    for (i = 0, end = length - 2; i <= end; i++) {
-        /* figure out tuple id */
+    positions = p;
+
+    /* sort the positions of tuples of size 2 by tuple id */
+    for (t = 0; t <= 16; t++)
+        starts[t] = 0;
+    for (i = 0; i <= end; i++)
+        starts[Index[pattern[i]] * 4 + Index[pattern[i + 1]] + 1]++;
+    for (t = 1; t <= 16; t++)
+        starts[t] += starts[t - 1];
+    for (i = 0; i <= end; i++) {
         tupid = Index[pattern[i]] * 4 + Index[pattern[i + 1]];
+        positions[starts[tupid]++] = i;
+    }
+    for (t = 16; t > 0; t--)
+        starts[t] = starts[t - 1];
+    starts[0] = 0;
+
+    /* 11/17/15 G. Benson */
+    /* limit maximum length of distance recorded between tuples to MAXDISTANCECONSTANT*3 = 6,000 */
+    /* this should be long enough to deter finding periods that are not the most frequent */
+    /* Each tuple is paired with every earlier occurrence closer than that, and with the
+     * nearest one beyond it. Only the number of pairs and the sum of their distances
+     * enter the regression below, so they are summed per tuple id in a sliding window
+     * rather than recorded by distance. */
+    pairs = distsum = nearpairs = 0;
+    for (t = 0; t < 16; t++) {
+        far = near = starts[t];
+        windowsum = 0;
+        for (k = starts[t]; k < starts[t + 1]; k++) {
+            i = positions[k];
+            while (i - positions[far] >= MAXDISTANCECONSTANT * 3) {
+                windowsum -= positions[far];
+                far++;
+            }
+            pairs += k - far;
+            distsum += (long long)(k - far) * i - windowsum;
+            if (far > starts[t]) {
+                pairs++;
+                distsum += i - positions[far - 1];
+            }
+            windowsum += i;
 
-        /* record last occurence into history and update heads[] pointer */
-        history[i] = heads[tupid];
-        heads[tupid] = i;
+            while (i - positions[near] > maxd)
+                near++;
+            nearpairs += k - near;
+        }
+    }
 
-        /* loop into history and add distances */
-        /* 11/17/15 G. Benson */
-        /* limit maximum length of distance recorded between tuples to MAXDISTANCECONSTANT*3 = 6,000 */
-        /* this should be long enough to deter finding periods that are not the most frequent */
-        /* Without this change, this procudure is quadratic in the length, which could be several million */
-        /* and caused the program to hang with long centromeric repeats */
-        /* for(curr=i;history[curr]!=-1;curr=history[curr]) */
-        dist = 0;
-        for (curr = i; ((history[curr] != -1) && (dist < (MAXDISTANCECONSTANT * 3))); curr = history[curr]) {
-            dist = i - history[curr];
-            counts[dist] += 1.0;
+    /* count pairs by distance up to maxd, walking the pairs if there are
+     * few of them, or else by packed comparison of the pattern with itself */
+    words = length / 32 + 3;
+    if (nearpairs > 4LL * maxd * words) {
+        p = grow_scratch(packed, &packedsize, words, sizeof *packed);
+        if (p == NULL)
+            return 1;
+        packed = p;
+        memset(packed, 0, words * sizeof *packed);
+        for (i = 0; i < length; i++)
+            packed[i / 32 + 1] |= (unsigned long long)Index[pattern[i]] << (2 * (i % 32));
+        count_dinucleotide_matches(packed, length, maxd, counts);
+    }
+    else {
+        for (i = 1; i <= maxd; i++)
+            counts[i] = 0.0;
+        for (t = 0; t < 16; t++) {
+            for (k = starts[t]; k < starts[t + 1]; k++) {
+                for (j = k - 1; j >= starts[t] && positions[k] - positions[j] <= maxd; j--)
+                    counts[positions[k] - positions[j]] += 1.0;
+            }
         }
     }
+    counts[0] = 0.0;
 
     /* compute slope using least-square regression */
-    xysum = xsum = ysum = x2sum = 0.0;
-    end = length - 2;
+    /* the sums of counts are integers, so they are exact however summed */
+    xysum = (double)distsum;
+    ysum = (double)pairs;
+    xsum = x2sum = 0.0;
     for (i = 1; i <= end; i++) {
-        xysum += (i * counts[i]);
         xsum += (i);
-        ysum += (counts[i]);
         x2sum += (i * i);
     }
     n = end;
     s = (n * xysum - xsum * ysum) / (n * x2sum - xsum * xsum);
 
     /* flatten trend by adding -s per increment */
-    end = length - 2;
-    for (i = 1; i <= end; i++) {
+    for (i = 1; i <= maxd; i++) {
         counts[i] = counts[i] - i * s;
     }
 
     /* pick highest values */
-    end = length - 2;
-    if (end > g_MAXDISTANCE)
-        end = g_MAXDISTANCE;      /* 3/14/05 accepts smaller multiples is best ones are too large */
     for (t = 0; t < NUMBER_OF_PERIODS; t++) {
         /* do t passes to find t highes counts */
         topind = 0;
         topval = 0.0;
-        for (i = 1; i <= end; i++) {
+        for (i = 1; i <= maxd; i++) {
             if (counts[i] > topval) {
                 topind = i;
                 topval = counts[i];
@@ -2135,10 +2386,6 @@ int GetTopPeriods(unsigned char *pattern, int length, int *toparray)
         counts[topind] = 0.0;
     }
 
-    /* free memory */
-    free(counts);
-    free(history);
-
     return 0;
 }
 
@@ -2382,7 +2629,8 @@ void print_flanking_sequence(int flank_length)
         fprintf(Fptxt, "\nLeft flanking sequence: None");
     }
     else {
-        fprintf(Fptxt, "\nLeft flanking sequence: Indices %d -- %d\n", m, AlignPair.indexprime[1] - 1);
+        fprintf(Fptxt, "\nLeft flanking sequence: Indices %d -- %d\n", m + Sequenceoffset,
+            AlignPair.indexprime[1] - 1 + Sequenceoffset);
         k = AlignPair.indexprime[1];
         j = m;
         for (;;) {
@@ -2402,7 +2650,7 @@ void print_flanking_sequence(int flank_length)
     }
     else {
         fprintf(Fptxt, "\n\nRight flanking sequence: Indices %d -- %d\n",
-            AlignPair.indexprime[AlignPair.length] + 1, n);
+            AlignPair.indexprime[AlignPair.length] + 1 + Sequenceoffset, n + Sequenceoffset);
         j = AlignPair.indexprime[AlignPair.length] + 1;
         for (;;) {
             for (i = 1; i <= pwidth - 10; i++) {
@@ -2422,21 +2670,15 @@ void print_flanking_sequence(int flank_length)
 
 }
 
-void printECtoAlignments(FILE *fp, int start, int width)
+void print_consensus_pattern(FILE *fp, const char *pattern, int width)
 {
-    int counter;
-    int chars = 0;
+    int chars;
 
-    fprintf(Fptxt, "\nConsensus pattern (%d bp):   ", width);
-    for (counter = start; counter < width; counter++, chars++) {
+    fprintf(fp, "\nConsensus pattern (%d bp):   ", width);
+    for (chars = 0; chars < width; chars++) {
         if (chars % 65 == 0)
             fprintf(fp, "\n");
-        fprintf(fp, "%c", EC[counter]);
-    }
-    for (counter = 0; counter < start; counter++, chars++) {
-        if (chars % 65 == 0)
-            fprintf(fp, "\n");
-        fprintf(fp, "%c", EC[counter]);
+        fprintf(fp, "%c", pattern[chars]);
     }
 
     fprintf(fp, "\n");
@@ -2472,6 +2714,174 @@ void printECtoData(FILE *fp, int start, int width)
     return;
 }
 
+/******************** edit strings *********************/
+
+static char *Editbuffer = NULL;
+static size_t Editbuffersize = 0;
+
+/* appends a run of n edits op to Editbuffer at *used */
+static void append_edit_run(size_t *used, int n, char op)
+{
+    char *grown;
+
+    /* room for the count, the op and the terminating null */
+    if (*used + 16 > Editbuffersize) {
+        grown = realloc(Editbuffer, 2 * Editbuffersize + 64);
+        if (grown == NULL) {
+            trf_message("\nAppend_edit_run: Out of memory!");
+            exit(-1);
+        }
+        Editbuffer = grown;
+        Editbuffersize = 2 * Editbuffersize + 64;
+    }
+    *used += sprintf(Editbuffer + *used, "%d%c", n, op);
+}
+
+/* Returns a newly allocated run-length edit string of the alignment in
+ * AlignPair, which must be in forward order: '=' for a match, 'X' for a
+ * mismatch, 'I' for a letter of the sequence against a gap in the
+ * pattern and 'D' for a letter of the pattern against a gap in the
+ * sequence, each preceded by its count, as in "12=1X3=1I". */
+static char *get_edit_string(void)
+{
+    size_t used;
+    int i, n;
+    char op, last;
+    char *edits;
+
+    used = 0;
+    n = 0;
+    last = 0;
+    for (i = 1; i <= AlignPair.length; i++) {
+        if (AlignPair.textsecnd[i] == '-')
+            op = 'I';
+        else if (AlignPair.textprime[i] == '-')
+            op = 'D';
+        else if (AlignPair.textprime[i] == AlignPair.textsecnd[i])
+            op = '=';
+        else
+            op = 'X';
+        if (op != last && n > 0) {
+            append_edit_run(&used, n, last);
+            n = 0;
+        }
+        last = op;
+        n++;
+    }
+    if (n > 0)
+        append_edit_run(&used, n, last);
+
+    edits = malloc(used + 1);
+    if (edits == NULL) {
+        trf_message("\nGet_edit_string: Out of memory!");
+        exit(-1);
+    }
+    memcpy(edits, Editbuffer != NULL ? Editbuffer : "", used + 1);
+    return edits;
+}
+
+/* Rebuilds in AlignPair, in forward order, the alignment that edits
+ * describes of the sequence from first against the pattern of the given
+ * size, starting at pattern position 0. With check set, AlignPair is
+ * left alone and the result is whether it already holds exactly that
+ * alignment. */
+static int decode_edit_string(const char *edits, int first, const char *pattern, int size, int check)
+{
+    int l, n, p, s;
+    char prime, secnd;
+    int indexprime, indexsecnd;
+
+    l = 0;
+    p = first;
+    s = 0;
+    while (*edits != '\0') {
+        n = 0;
+        while (*edits >= '0' && *edits <= '9')
+            n = 10 * n + (*edits++ - '0');
+        for (; n > 0; n--) {
+            indexprime = p;
+            indexsecnd = s;
+            if (*edits == 'D') {
+                prime = '-';
+                secnd = pattern[s];
+            }
+            else {
+                if (p > Length)
+                    return FALSE;
+                prime = Sequence[p++];
+                secnd = (*edits == 'I') ? '-' : pattern[s];
+            }
+            if (*edits != 'I')
+                s = (s + 1) % size;
+            l++;
+            if (check) {
+                if (l > AlignPair.length || AlignPair.textprime[l] != prime || AlignPair.textsecnd[l] != secnd
+                    || AlignPair.indexprime[l] != indexprime || AlignPair.indexsecnd[l] != indexsecnd)
+                    return FALSE;
+            }
+            else {
+                AlignPair.textprime[l] = prime;
+                AlignPair.textsecnd[l] = secnd;
+                AlignPair.indexprime[l] = indexprime;
+                AlignPair.indexsecnd[l] = indexsecnd;
+            }
+        }
+        edits++;
+    }
+    if (check)
+        return l == AlignPair.length;
+    AlignPair.length = l;
+    return TRUE;
+}
+
+/* prints what the alignment file shows for entry, whose alignment must
+ * be in AlignPair in forward order */
+static void print_alignment_text(const struct index_list *entry)
+{
+    const struct alignrecord *record = entry->il_record;
+    int g, x;
+
+    print_alignment_headings(entry);
+    alt3_print_alignment(entry->il_size);
+
+    x = record->match + record->mismatch + record->indel;
+    fprintf(Fptxt, "\nStatistics");
+    fprintf(Fptxt, "\nMatches: %d,  Mismatches: %d, Indels: %d", record->match, record->mismatch, record->indel);
+    fprintf(Fptxt, "\n        %0.2f            %0.2f        %0.2f",
+        (float)record->match / x, (float)record->mismatch / x, (float)record->indel / x);
+    fprintf(Fptxt, "\n");
+    fprintf(Fptxt, "\nMatches are distributed among these distances:");
+    for (g = 0; g < 2 * record->ndistances; g += 2)
+        fprintf(Fptxt, "\n %3d  %3d  %0.2f", record->distances[g], record->distances[g + 1],
+            (float)record->distances[g + 1] / record->match);
+
+    if (record->count != 0)
+        fprintf(Fptxt, "\n\nACGTcount: A:%3.2f, C:%3.2f, G:%3.2f, T:%3.2f",
+            (double)record->acgtcount[0] / record->count, (double)record->acgtcount[1] / record->count,
+            (double)record->acgtcount[2] / record->count, (double)record->acgtcount[3] / record->count);
+    else
+        fprintf(Fptxt, "\nError in statistics: ACGTcount=0");
+
+    fprintf(Fptxt, "\n");
+    fprintf(Fptxt, "\n");
+
+    /* prints line showing the consensus pattern */
+    print_consensus_pattern(Fptxt, entry->il_pattern, entry->il_size);
+
+    if (print_flanking)
+        print_flanking_sequence(g_paramset.ps_flankinglength);
+}
+
+void PrintAlignmentRecord(FILE *fp, const struct index_list *entry)
+{
+    FILE *saved = Fptxt;
+
+    Fptxt = fp;
+    decode_edit_string(entry->il_edits, entry->il_first, entry->il_pattern, entry->il_size, 0);
+    print_alignment_text(entry);
+    Fptxt = saved;
+}
+
 /************************************************************/
 
 /*******************************************************************/
@@ -2492,12 +2902,11 @@ void get_statistics(int consensussize)
     int size;
     int startECpos;             /* to print consensus pattern */
     int ACGTcount[26];
+    char *edits;
+    struct alignrecord *record;
 
     size = consensussize;
 
-    for (g = 1; g <= g_MAXDISTANCE + d_range(g_MAXDISTANCE); g++)
-        Statistics_Distance[g] = 0;
-
     match = 0;
     mismatch = 0;
     indel = 0;
@@ -2680,30 +3089,64 @@ void get_statistics(int consensussize)
     reverse();
     Period = best_match_distance;
 
-    if (!g_paramset.ps_HTMLoff)
-        print_alignment_headings(Classlength);
-
     /* save the starting position of consensus in EC */
     startECpos = (int)AlignPair.indexsecnd[1];
 
+    /* the alignment file numbers pattern positions from the start of
+     * the consensus, as does the edit string */
     if (!g_paramset.ps_HTMLoff)
-        alt3_print_alignment(Classlength);
+        shift_pattern_indices(Classlength);
+
+    edits = NULL;
+    if (!g_paramset.ps_HTMLoff || g_paramset.ps_cigar)
+        edits = get_edit_string();
 
     reverse();
 
+    /* keep what the alignment text needs, so that it can be printed once
+     * the repeat is known to survive TRFClean */
+    record = NULL;
     if (!g_paramset.ps_HTMLoff) {
-        fprintf(Fptxt, "\nStatistics");
-        fprintf(Fptxt, "\nMatches: %d,  Mismatches: %d, Indels: %d", match, mismatch, indel);
-        fprintf(Fptxt, "\n        %0.2f            %0.2f        %0.2f",
-            (float)match / x, (float)mismatch / x, (float)indel / x);
-        fprintf(Fptxt, "\n");
-        fprintf(Fptxt, "\nMatches are distributed among these distances:");
+        record = malloc(sizeof *record);
+        if (record == NULL) {
+            free(edits);
+            FreeList(GlobalIndexList);
+            GlobalIndexList = NULL;
+            GlobalIndexListTail = NULL;
+            return;
+        }
+        record->score = Maxscore;
+        record->copynumber = Copynumber;
+        record->outputcount = (int)OUTPUTcount;
+        record->match = match;
+        record->mismatch = mismatch;
+        record->indel = indel;
+        record->ndistances = 0;
+        for (g = mindistance; g <= maxdistance; g++)
+            if (Statistics_Distance[g] != 0)
+                record->ndistances++;
+        record->distances = malloc(2 * record->ndistances * sizeof *record->distances);
+        if (record->distances == NULL) {
+            free(record);
+            free(edits);
+            FreeList(GlobalIndexList);
+            GlobalIndexList = NULL;
+            GlobalIndexListTail = NULL;
+            return;
+        }
+        i = 0;
         for (g = mindistance; g <= maxdistance; g++)
             if (Statistics_Distance[g] != 0) {
-                fprintf(Fptxt, "\n %3d  %3d  %0.2f", g, Statistics_Distance[g], (float)Statistics_Distance[g] / match);
+                record->distances[i++] = g;
+                record->distances[i++] = Statistics_Distance[g];
             }
     }
 
+    /* only the distances from mindistance to maxdistance were counted, so
+     * clearing those leaves Statistics_Distance zeroed for the next call */
+    for (g = mindistance; g <= maxdistance; g++)
+        Statistics_Distance[g] = 0;
+
     ACGTcount['A' - 'A'] = 0;
     ACGTcount['C' - 'A'] = 0;
     ACGTcount['G' - 'A'] = 0;
@@ -2718,12 +3161,13 @@ void get_statistics(int consensussize)
         i++;
     }
 
-    if (count != 0)
-        trf_message("\n\nACGTcount: A:%3.2f, C:%3.2f, G:%3.2f, T:%3.2f",
-            (double)ACGTcount['A' - 'A'] / count, (double)ACGTcount['C' - 'A'] / count,
-            (double)ACGTcount['G' - 'A'] / count, (double)ACGTcount['T' - 'A'] / count);
-    else
-        trf_message("\nError in statistics: ACGTcount=0");
+    if (record != NULL) {
+        record->acgtcount[0] = ACGTcount['A' - 'A'];
+        record->acgtcount[1] = ACGTcount['C' - 'A'];
+        record->acgtcount[2] = ACGTcount['G' - 'A'];
+        record->acgtcount[3] = ACGTcount['T' - 'A'];
+        record->count = count;
+    }
 
     diversity[0] = (double)ACGTcount['A' - 'A'] / count;
     diversity[1] = (double)ACGTcount['C' - 'A'] / count;
@@ -2746,11 +3190,6 @@ void get_statistics(int consensussize)
     if (entropy < 0)
         entropy = -entropy;
 
-    if (!g_paramset.ps_HTMLoff) {
-        fprintf(Fptxt, "\n");
-        fprintf(Fptxt, "\n");
-    }
-
     /*  changed by Gary Benson, 6/1/99, to remove summary
      * information and add flanking sequence */
 
@@ -2765,26 +3204,14 @@ void get_statistics(int consensussize)
      * entropy);
      */
 
-    /* prints line showing the consensus pattern */
-
-    if (!g_paramset.ps_HTMLoff) {
-
-        printECtoAlignments(Fptxt, startECpos, consensussize);
-
-        if (print_flanking) {
-            reverse();
-            print_flanking_sequence(g_paramset.ps_flankinglength);
-            reverse();
-        }
-
-    }
-
     /* To have smaller sequences not send results */
     /* to disc to improve performance             */
     {
         /* create new index list element */
         struct index_list *newptr =  malloc(sizeof *newptr);
         if (newptr == NULL) {
+            FreeAlignmentRecord(record);
+            free(edits);
             FreeList(GlobalIndexList);
             GlobalIndexList = NULL;
             GlobalIndexListTail = NULL;
@@ -2797,7 +3224,8 @@ void get_statistics(int consensussize)
 
         /* assign data to fields */
         sprintf(newptr->il_ref, "%d--%d,%d,%3.1f,%d,%d",
-            AlignPair.indexprime[AlignPair.length], AlignPair.indexprime[1], best_match_distance, Copynumber,
+            AlignPair.indexprime[AlignPair.length] + Sequenceoffset, AlignPair.indexprime[1] + Sequenceoffset,
+            best_match_distance, Copynumber,
             Classlength, (int)OUTPUTcount);
 
         newptr->il_first = AlignPair.indexprime[AlignPair.length];
@@ -2817,6 +3245,8 @@ void get_statistics(int consensussize)
         /* allocate memory to place the pattern and copy data into it */
         newptr->il_pattern = malloc(consensussize + 1);
         if (newptr->il_pattern == NULL) {
+            FreeAlignmentRecord(record);
+            free(edits);
             free(newptr);
             FreeList(GlobalIndexList);
             GlobalIndexList = NULL;
@@ -2825,6 +3255,23 @@ void get_statistics(int consensussize)
         }
 
         printECtoBuffer(newptr->il_pattern, startECpos, consensussize);
+        newptr->il_alignment = Alignmentmark;
+        newptr->il_edits = edits;
+        newptr->il_record = record;
+
+        /* defer the alignment text to WriteAlignments, unless the edit
+         * string cannot reproduce the alignment exactly */
+        if (record != NULL) {
+            reverse();
+            if (decode_edit_string(edits, newptr->il_first, newptr->il_pattern, consensussize, 1))
+                SetAlignmentSlot(Alignmentmark);
+            else {
+                print_alignment_text(newptr);
+                FreeAlignmentRecord(record);
+                newptr->il_record = NULL;
+            }
+            reverse();
+        }
 
         if (GlobalIndexList == NULL) {  
             /* first element */
@@ -3381,12 +3828,42 @@ void init_and_fill_coin_toss_stats2000_with_4tuplesizes(void)
         565, 566, 566, 566, 567
     };
 
-    int g, d;
-    const int *waitdata, *sumdata;
+    /* schedules of the built-in tables, used as defaults for other PM */
+    static const int sizes80[] = { 4, 5, 7 }, starts80[] = { 1, 30, 160 };
+    static const int sizes75[] = { 3, 4, 5, 7 }, starts75[] = { 1, 30, 44, 160 };
+    static const int sizesfast[] = { 8, 10, 12 };
+    static int genwaitdata[TS_MAXDISTANCE + 1], gensumdata[TS_MAXDISTANCE + 1];
+    static int generated = 0;
+
+    int g, d, ntuples, last, least;
+    const int *waitdata, *sumdata, *sizes, *masks, *starts;
 
     /* random walk range */
     trf_message("\nPmatch=%3.2f,Pindel=%3.2f", (float)g_PM / 100, (float)g_PI / 100);
     g_Pindel = (float)g_PI / 100;
+
+    /* alignment parameters, so that newtupbo need not recompute them */
+    Alignplan = calloc(2 * (g_MAXDISTANCE + 1), sizeof *Alignplan);
+    if (Alignplan == NULL) {
+        fprintf(stderr, "\nUnable to allocate Alignplan array");
+        exit(-1);
+    }
+    for (g = 1; g < 2 * (g_MAXDISTANCE + 1); g++) {
+        Alignplan[g].range = d_range(g);
+        Alignplan[g].bandradius = max(MINBANDRADIUS, Alignplan[g].range);
+        Alignplan[g].bandradiusforward = min(2 * Alignplan[g].bandradius, (g / 3));
+        Alignplan[g].narrowband = (g > SMALLDISTANCE);
+
+        /* number of copies required ramps from 1.9 at pattern size = 50
+         * down to 1.8 at pattern size = 100 or above */
+        if (g <= 50)
+            Alignplan[g].mincopynumber = 1.9;
+        else if (g <= 100)
+            Alignplan[g].mincopynumber = 1.9 - 0.002 * (g - 50);
+        else
+            Alignplan[g].mincopynumber = 1.8;
+    }
+
     for (g = 1; g <= g_MAXDISTANCE; g++) {
         if (g <= SMALLDISTANCE) {
             Distance[g].lo_d_range = g /* this can never be less than one */ ;
@@ -3394,15 +3871,28 @@ void init_and_fill_coin_toss_stats2000_with_4tuplesizes(void)
             /* than g_MAXDISTANCE */
         }
         else {
-            Distance[g].lo_d_range = max(g - d_range(g), 1);    /* this can never be less than one */
+            Distance[g].lo_d_range = max(g - Alignplan[g].range, 1);    /* this can never be less than one */
 
-            Distance[g].hi_d_range = min(g + d_range(g), g_MAXDISTANCE);  /* this can never be greater */
+            Distance[g].hi_d_range = min(g + Alignplan[g].range, g_MAXDISTANCE);  /* this can never be greater */
             /* than MAXDISTANCE */
         }
     }
 
+    /* -fast preset: long tuples only, placed by the k+1 rule. An
+     * explicit -tuples schedule takes precedence. */
+    if (g_paramset.ps_fast && g_paramset.ps_tuplecount == 0) {
+        memcpy(g_paramset.ps_tuplesizes, sizesfast, sizeof sizesfast);
+        memset(g_paramset.ps_tuplemasks, 0, sizeof g_paramset.ps_tuplemasks);
+        g_paramset.ps_tuplecount = FitTupleSchedule(g_PM, sizeof sizesfast / sizeof *sizesfast,
+            g_paramset.ps_tuplesizes, g_paramset.ps_tuplestarts);
+        if (g_paramset.ps_tuplecount == 0) {
+            fprintf(stderr, "\nUnable to compute tuple schedule for PM=%d", g_PM);
+            exit(-13);
+        }
+    }
+
     /* Waiting time calculations */
-    if (g_PM == 80) {
+    if (g_paramset.ps_tuplecount == 0 && g_PM == 80) {
         NTS = 3;                /* Tuplesize[NTS+1]={0,4,5,7}; */
         Tuplesize[0] = 0;
         Tuplesize[1] = 4;
@@ -3417,8 +3907,9 @@ void init_and_fill_coin_toss_stats2000_with_4tuplesizes(void)
 
         /* assign pointers to data */
         waitdata = waitdata80;
+        sumdata = sumdata80;
     }
-    else if (g_PM == 75) {
+    else if (g_paramset.ps_tuplecount == 0 && g_PM == 75) {
         NTS = 4;
         Tuplesize[0] = 0;
         Tuplesize[1] = 3;
@@ -3435,13 +3926,85 @@ void init_and_fill_coin_toss_stats2000_with_4tuplesizes(void)
 
         /* assign pointers to strings with data */
         waitdata = waitdata75;
+        sumdata = sumdata75;
     }
     else {
-        trf_message("\nNo wait table file for PM=%d", g_PM);
-        fprintf(stderr, "\nNo wait table file for PM=%d", g_PM);
-        exit(-13);
+        /* Any other PM, or a user supplied tuple schedule. Without a
+         * schedule use the one of the nearest built-in table. */
+        masks = NULL;
+        if (g_paramset.ps_tuplecount > 0) {
+            ntuples = g_paramset.ps_tuplecount;
+            sizes = g_paramset.ps_tuplesizes;
+            masks = g_paramset.ps_tuplemasks;
+            starts = g_paramset.ps_tuplestarts;
+        }
+        else if (g_PM > 80) {
+            ntuples = 3;
+            sizes = sizes80;
+            starts = starts80;
+        }
+        else {
+            ntuples = 4;
+            sizes = sizes75;
+            starts = starts75;
+        }
+
+        /* the tables only depend on the parameters, so compute them once */
+        if (!generated) {
+            if (GetTupleStats(g_PM, ntuples, sizes, masks, starts, genwaitdata, gensumdata) != 0) {
+                trf_message("\nUnable to compute wait and sum tables for PM=%d", g_PM);
+                fprintf(stderr, "\nUnable to compute wait and sum tables for PM=%d", g_PM);
+                exit(-13);
+            }
+
+            /* -fast starts its first size at d=1 like the built-in
+             * tables, but an 8-mer in a short window has a generated
+             * criterion of 0, which any single random hit meets. Ask
+             * for k+1, two overlapping hits, as the built-in 4-mer
+             * criterion of 5 does. */
+            if (g_paramset.ps_fast) {
+                last = ntuples > 1 ? starts[1] - 1 : TS_MAXDISTANCE;
+                least = (masks && masks[0] ? SeedWeight(masks[0]) : sizes[0]) + 1;
+                for (d = starts[0]; d <= min(last, TS_MAXDISTANCE); d++)
+                    if (gensumdata[d] < least)
+                        gensumdata[d] = least;
+            }
+            generated = 1;
+        }
+
+        /* drop tuple sizes that start beyond the largest distance */
+        NTS = 0;
+        Tuplesize[0] = 0;
+        for (g = 0; g < ntuples && starts[g] <= g_MAXDISTANCE; g++) {
+            NTS++;
+            Tuplesize[NTS] = sizes[g];
+            Tuplemask[NTS] = masks ? masks[g] : 0;
+            Tupleweight[NTS] = Tuplemask[NTS] ? SeedWeight(Tuplemask[NTS]) : sizes[g];
+            Tuplemaxdistance[NTS - 1] = starts[g] - 1;
+        }
+        Tuplemaxdistance[NTS] = g_MAXDISTANCE;
+
+        trf_message("\ntuple sizes 0");
+        for (g = 1; g <= NTS; g++)
+            if (Tuplemask[g])
+                trf_message(",%d(seed of weight %d)", Tuplesize[g], Tupleweight[g]);
+            else
+                trf_message(",%d", Tuplesize[g]);
+        trf_message("\ntuple distances 0");
+        for (g = 1; g <= NTS; g++)
+            trf_message(", %d", Tuplemaxdistance[g]);
+
+        waitdata = genwaitdata;
+        sumdata = gensumdata;
     }
 
+    /* the built-in tables only use plain tuples */
+    if (waitdata == waitdata80 || waitdata == waitdata75)
+        for (g = 1; g <= NTS; g++) {
+            Tuplemask[g] = 0;
+            Tupleweight[g] = Tuplesize[g];
+        }
+
     /* Oct 15, 2018 Yozen: truncate value of g_MAXDISTANCE to 2000
      * if it exceeds that value, to avoid out-of-bounds crashes here.
      * Arrays are only as large as 2004. This is a temporary change
@@ -3453,20 +4016,6 @@ void init_and_fill_coin_toss_stats2000_with_4tuplesizes(void)
 
     /* k_run_sums_criteria */
 
-    if (g_PM == 80) {
-        /* assign pointers to strings with data */
-        sumdata = sumdata80;
-    }
-    else if (g_PM == 75) {
-        /* assign pointers to strings with data */
-        sumdata = sumdata75;
-    }
-    else {
-        trf_message("\nNo sum table file for PM=%d", g_PM);
-        fprintf(stderr, "\nNo sum table file for PM=%d", g_PM);
-        exit(-13);
-    }
-
     /* Oct 15, 2018 Yozen: truncate value of g_MAXDISTANCE to 2000 */
     for (d = 1; d <= g_MAXDISTANCE; d++)
         Distance[d].k_run_sums_criteria = sumdata[min(2000, d)];
@@ -3474,13 +4023,360 @@ void init_and_fill_coin_toss_stats2000_with_4tuplesizes(void)
 
 extern void SetProgressBar(void);
 
+/* Tuplehash access. Large tuple sizes use an open addressing table
+ * with linear probing; erasing shifts later entries of the probe
+ * sequence back so that lookups never need tombstones. */
+static inline unsigned int tuplehash_slot(int g, int code)
+{
+    return ((unsigned int)code * 2654435761u) >> (32 - Tuplehashbits[g]);
+}
+
+static inline int tuplehash_lookup(int g, int code)
+{
+    struct tuplehashentry *table;
+    unsigned int mask, slot;
+
+    if (Tuplehashbits[g] == 0)
+        return Tuplehash[g][code];
+
+    table = Tuplehashtable[g];
+    mask = (1u << Tuplehashbits[g]) - 1;
+    for (slot = tuplehash_slot(g, code); table[slot].index != 0; slot = (slot + 1) & mask)
+        if (table[slot].code == code)
+            return table[slot].index;
+
+    return 0;
+}
+
+/* stores index for code; index 0 erases the code */
+static inline void tuplehash_store(int g, int code, int index)
+{
+    struct tuplehashentry *table;
+    unsigned int mask, slot, next, home;
+
+    if (Tuplehashbits[g] == 0) {
+        Tuplehash[g][code] = index;
+        return;
+    }
+
+    table = Tuplehashtable[g];
+    mask = (1u << Tuplehashbits[g]) - 1;
+    for (slot = tuplehash_slot(g, code); table[slot].index != 0; slot = (slot + 1) & mask)
+        if (table[slot].code == code)
+            break;
+
+    if (index != 0) {
+        table[slot].code = code;
+        table[slot].index = index;
+        return;
+    }
+
+    if (table[slot].index == 0)
+        return;
+
+    /* move back any entry whose home slot does not lie in (slot, next] */
+    table[slot].index = 0;
+    for (next = (slot + 1) & mask; table[next].index != 0; next = (next + 1) & mask) {
+        home = tuplehash_slot(g, table[next].code);
+        if (slot <= next ? (slot < home && home <= next) : (slot < home || home <= next))
+            continue;
+
+        table[slot] = table[next];
+        table[next].index = 0;
+        slot = next;
+    }
+}
+
+/* code of the compared positions of a spaced seed, from the code of
+ * its whole span */
+static inline int spaced_seed_code(int code, int mask, int span)
+{
+    int seedcode = 0, p;
+
+    for (p = span - 1; p >= 0; p--)
+        if (mask & (1 << p))
+            seedcode = seedcode * 4 + (code / four_to_the[p]) % 4;
+
+    return seedcode;
+}
+
+/* Packs Sequence[0..Length] for the self comparison. Position 0 and
+ * positions past Length count as non ACGT, as does the padding word. */
+static int pack_self_compare_sequence(void)
+{
+    int words, p, w, q;
+
+    words = Length / 32 + 2;
+    Selfcomparebases = calloc(words, sizeof *Selfcomparebases);
+    Selfcomparebad = calloc(words, sizeof *Selfcomparebad);
+    if (Selfcomparebases == NULL || Selfcomparebad == NULL) {
+        free(Selfcomparebases);
+        free(Selfcomparebad);
+        Selfcomparebases = Selfcomparebad = NULL;
+        return FALSE;
+    }
+
+    for (w = 0; w < words; w++)
+        Selfcomparebad[w] = 0x5555555555555555ULL;
+
+    for (p = 1; p <= Length; p++) {
+        if (!Validbase[Sequence[p]])
+            continue;
+        w = p / 32 + 1;
+        q = 2 * (p % 32);
+        Selfcomparebases[w] |= (unsigned long long)Index[Sequence[p]] << q;
+        Selfcomparebad[w] &= ~(1ULL << q);
+    }
+
+    Selfcompareblock = -1;
+    return TRUE;
+}
+
+/* Low bit of each two bit lane set where the base of word w differs
+ * from the base d positions back, or either is not ACGT. */
+static inline unsigned long long self_compare_mismatches(int w, int d)
+{
+    unsigned long long bases, back, bad, x;
+
+    if (w == 0)
+        return 0x5555555555555555ULL;
+
+    bases = Selfcomparebases[w];
+    back = (bases << 2 * d) | (Selfcomparebases[w - 1] >> (64 - 2 * d));
+    bad = Selfcomparebad[w] | (Selfcomparebad[w] << 2 * d) | (Selfcomparebad[w - 1] >> (64 - 2 * d));
+    x = bases ^ back;
+    return ((x | (x >> 1)) & 0x5555555555555555ULL) | bad;
+}
+
+/* index of the lowest set two bit lane */
+static inline int lowest_lane(unsigned long long lanes)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(lanes) / 2;
+#else
+    int q = 0;
+
+    while (!(lanes & 1)) {
+        lanes >>= 2;
+        q++;
+    }
+    return q;
+#endif
+}
+
+/* index of the highest set two bit lane */
+static inline int highest_lane(unsigned long long lanes)
+{
+#if defined(__GNUC__)
+    return (63 - __builtin_clzll(lanes)) / 2;
+#else
+    int q = 31;
+
+    while (!(lanes >> 62)) {
+        lanes <<= 2;
+        q--;
+    }
+    return q;
+#endif
+}
+
+/* Number of consecutive positions x, x+step, ... (at most limit) whose
+ * base equals the one d positions back. Uses the packed sequence a word
+ * at a time when it is there, where bases that are not ACGT count as
+ * different. */
+static int periodic_extent(int x, int d, int step, int limit)
+{
+    unsigned long long m;
+    int n = 0, q;
+
+    if (Selfcomparebases == NULL || d > SELFCOMPAREMAXDISTANCE) {
+        while (n < limit && x - d >= 1 && x <= Length && Sequence[x] == Sequence[x - d]) {
+            n++;
+            x += step;
+        }
+        return n;
+    }
+
+    while (n < limit && x >= 1 && x <= Length) {
+        m = self_compare_mismatches(x / 32 + 1, d);
+        q = x % 32;
+        if (step > 0) {
+            m >>= 2 * q;
+            if (m != 0)
+                return min(limit, n + lowest_lane(m));
+            n += 32 - q;
+            x += 32 - q;
+        }
+        else {
+            m <<= 2 * (31 - q);
+            if (m != 0)
+                return min(limit, n + 31 - highest_lane(m));
+            n += q + 1;
+            x -= q + 1;
+        }
+    }
+
+    return min(limit, n);
+}
+
+/* Fills Selfcomparehits for the 32 positions of word w. A tuple of size
+ * k matches d positions back where the last k lanes all match, which
+ * is tested for every lane of the word at once. */
+static void fill_self_compare_hits(int w)
+{
+    unsigned long long match, previous, runs;
+    int d, s, k;
+
+    k = Tuplesize[1];
+    memset(Selfcomparehits, 0, sizeof Selfcomparehits);
+    for (d = 1; d <= Selfcomparemaxdistance; d++) {
+        match = ~self_compare_mismatches(w, d) & 0x5555555555555555ULL;
+        if (match == 0)
+            continue;
+        previous = ~self_compare_mismatches(w - 1, d) & 0x5555555555555555ULL;
+
+        runs = match;
+        for (s = 1; s < k && runs != 0; s++)
+            runs &= (match << 2 * s) | (previous >> (64 - 2 * s));
+
+        while (runs != 0) {
+            Selfcomparehits[lowest_lane(runs)] |= 1u << d;
+            runs &= runs - 1;
+        }
+    }
+    Selfcompareblock = w;
+}
+
+/* Tests a tuple match of the given weight ending at location loc
+ * against the criteria for distance d, and aligns and reports the
+ * repeat if it passes. */
+static void process_tuple_match(int loc, int d, int weight)
+{
+    int found, pass_multiples_test;
+    struct alignplan *plan;
+
+    /* add tuplematch to Distance */
+    add_tuple_match_to_Distance_entry(loc, weight, d, Distance);
+
+    /* check if this distance has already been processed */
+
+    /* found=search_for_distance_match_in_distanceseenlist(d,i); */
+    /* modified 5/23/05 G. Benson */
+    found = search_for_distance_match_in_distanceseenarray(d, loc);
+
+    if (!found) {
+
+        /* is distance d linked into other nonzero distances? */
+        /* if not, link it in */
+        if (!Distance[d].linked)
+            link_Distance_window(d);
+
+        /* test criteria for candidate */
+
+        if ((new_meet_criteria_3(d, loc, weight))
+        && (d <= 250 || search_for_range_in_bestperiodlist(loc, d)))
+            /* use bestperiod list only for distances greater than 500 */
+        {
+            /* align sequence against candidate and get alignment */
+            WDPcount++;
+            Criteria_count[d]++;
+            Rows = 0;
+            plan = &Alignplan[d];
+            if (!plan->narrowband) {
+                newwrap(loc, d, WITHOUTCONSENSUS);
+                Cell_count[d] += (Rows * d);
+                get_pair_alignment_with_copynumber(d);
+            }
+            else {  /* d is a large distance */
+                if (1 % 100 == 0)
+                    fprintf(stderr, "\ni=%d  d=%d", loc, d);
+                narrowbandwrap(loc, d, plan->bandradius, plan->bandradiusforward,
+                    WITHOUTCONSENSUS, RECENTERCRITERION);
+                Cell_count[d] += (Rows * (2 * plan->bandradius + 1));
+                get_narrowband_pair_alignment_with_copynumber(d, plan->bandradiusforward, LOCAL);
+            }
+
+            if (Meet_criteria_print)
+                trf_message("\nFrom:%d, To:%d,  Copynumber:%f",
+                    AlignPair.indexprime[AlignPair.length], AlignPair.indexprime[1], Copynumber);
+
+            add_to_distanceseenarray(loc, d, Maxrealrow, Maxscore);
+
+            /*
+             * change to make number of copies required less restrictive for pattern sizes >= 50
+             * this ramps from 1.9 at pattern size = 50 down to 1.8 at pattern size = 100 or above */
+            if (Copynumber < plan->mincopynumber)
+                /* if(Copynumber<1.9) */
+                /* max(1.9,(double)Min_Distance_Window/(double)d)) */
+                /*  ceil((double)Min_Distance_Window/(double)d))) */
+                /* rationale for max here; Min_Distance_Window is the */
+                /* smallest actual tandem repeat we want to see, so */
+                /* divide by d to get minimum number of copies */
+            {
+            }
+            else {
+                pass_multiples_test = multiples_criteria_4(d);
+                add_to_bestperiodlist(d);
+                if (pass_multiples_test) {
+
+                    /* get consensus */
+                    Classlength = d;
+                    get_consensus(d);
+                    if (ConsClasslength != Classlength)
+                        Classlength = ConsClasslength;
+
+                    /* repeat alignment using consensus */
+                    Consensus_count[Classlength]++;
+                    Rows = 0;
+                    plan = &Alignplan[Classlength];
+                    if (!plan->narrowband) {
+                        newwrap(loc, Classlength, WITHCONSENSUS);
+                        Cell_count[Classlength] += (Rows * d);
+                        get_pair_alignment_with_copynumber(Classlength);
+                    }
+                    else {  /* d is a large distance */
+                        narrowbandwrap(loc, Classlength, plan->bandradius, plan->bandradiusforward,
+                            WITHCONSENSUS, RECENTERCRITERION);
+
+                        Cell_count[Classlength] += (Rows * (2 * plan->bandradius + 1));
+                        get_narrowband_pair_alignment_with_copynumber(Classlength,
+                            plan->bandradiusforward, LOCAL);
+                    }
+
+                    add_to_distanceseenarray(loc, d, Maxrealrow, Maxscore);
+                    adjust_bestperiod_entry(d);
+
+                    /* change to make number of copies required less restrictive for pattern sizes >= 50
+                     * this ramps from 1.9 at pattern size = 50 down to 1.8 at pattern size = 100 or above */
+                    /* inside the ramp, the threshold follows the original distance d */
+                    if (Copynumber < (Classlength > 50 && Classlength <= 100
+                        ? 1.9 - 0.002 * (d - 50) : plan->mincopynumber))
+                    {
+                    }
+                    else if (Classlength >= Minsize && AlignPair.score >= Minscore) {
+                        /* output repeat */
+                        OUTPUTcount++;
+                        Outputsize_count[Classlength]++;
+
+                        /* sequence, where its alignment text starts */
+                        trf_message("\n");
+                        Alignmentmark = MarkAlignment();
+                        trf_message("Found at i:%d original size:%d final size:%d", loc, d, Classlength);
+                        get_statistics(Classlength);
+                    }
+                }
+            }
+        }
+    }
+}
+
 /* uses different tuple sizes for different distances */
 void newtupbo(void)
 {
     int mintuplesize, maxtuplesize, build_entire_code, g, badcharindex;
     int code, y, i, h, d, yy, j;
-    int found, progbarpos, percentincrease, onepercent;
-    int pass_multiples_test;
+    int progbarpos, percentincrease, onepercent;
+    unsigned int hits;
 
     Bandcenter = calloc(maxwraplength + 1, sizeof *Bandcenter);
     // TODO: Add error test. boa@20240726
@@ -3499,14 +4395,27 @@ void newtupbo(void)
     mintuplesize = Tuplesize[1];
     maxtuplesize = Tuplesize[NTS];
     for (g = 1; g <= NTS; g++) {
-        Tuplehash[g] = calloc(four_to_the[Tuplesize[g]], sizeof(int));
-        // TODO: Add error check. boa@20240726
-
         Historysize[g] = 2 * (Tuplemaxdistance[g] + 1) + 2; 
         /* The idea here is that no previous history pointer points back */
         /* more than Tuplemaxdistance.  Then, when History entry is reused, following */
         /* links from the current will exceed the maxdistance before reaching the reused */
         /* entry. */
+
+        Tuplehash[g] = NULL;
+        Tuplehashtable[g] = NULL;
+        Tuplehashbits[g] = 0;
+        if (Tupleweight[g] <= MAXDIRECTTUPLESIZE) {
+            Tuplehash[g] = calloc(four_to_the[Tupleweight[g]], sizeof(int));
+            // TODO: Add error check. boa@20240726
+        }
+        else {
+            /* at most Historysize codes are live; keep the load under half */
+            Tuplehashbits[g] = 1;
+            while ((1 << Tuplehashbits[g]) < 2 * Historysize[g])
+                Tuplehashbits[g]++;
+            Tuplehashtable[g] = calloc(1 << Tuplehashbits[g], sizeof(struct tuplehashentry));
+        }
+
         History[g] = calloc(Historysize[g], sizeof(struct historyentry));
         // TODO: Add error check. boa@20240726
 
@@ -3517,6 +4426,13 @@ void newtupbo(void)
     Sortmultiples = calloc(g_MAXDISTANCE + 1, sizeof *Sortmultiples);
     // TODO: Add error check. boa@20240726
 
+    /* the self comparison replaces Tuplehash for the smallest tuple size
+     * when all of its distances fit in one word of shifts */
+    Selfcomparemaxdistance = 0;
+    if (Tuplemask[1] == 0 && Tuplemaxdistance[1] <= SELFCOMPAREMAXDISTANCE
+    && pack_self_compare_sequence())
+        Selfcomparemaxdistance = Tuplemaxdistance[1];
+
     build_entire_code = 1;
 
     onepercent = Length / 100;
@@ -3571,14 +4487,31 @@ void newtupbo(void)
         for (h = NTS - 1; h >= 1; h--)
             Tuplecode[h] = code % four_to_the[Tuplesize[h]];
 
+        /* spaced seeds keep only the compared positions of their span */
+        for (h = 1; h <= NTS; h++)
+            if (Tuplemask[h])
+                Tuplecode[h] = spaced_seed_code(Tuplecode[h], Tuplemask[h], Tuplesize[h]);
+
         /* process index i using all the tuplesizes */
         g = 1;
         while (g <= NTS && i - badcharindex >= Tuplesize[g]) {
+            /* matches of the smallest tuple size come from the self
+             * comparison, by increasing distance as from History */
+            if (g == 1 && Selfcomparemaxdistance > 0) {
+                if (i / 32 + 1 != Selfcompareblock)
+                    fill_self_compare_hits(i / 32 + 1);
+                hits = Selfcomparehits[i % 32];
+                for (d = 1; hits != 0 && d <= Selfcomparemaxdistance; d++)
+                    if (hits & (1u << d))
+                        process_tuple_match(i, d, Tupleweight[1]);
+                g++;
+                continue;
+            }
 
             /* change 5/25/99 ends here */
 
             /* index in history list of last occurrence of code */
-            y = Tuplehash[g][Tuplecode[g]]; 
+            y = tuplehash_lookup(g, Tuplecode[g]);
 
             /* next free index in history list */
             h = Nextfreehistoryindex[g];    
@@ -3590,14 +4523,14 @@ void newtupbo(void)
                 j = 1;          /* we use a circular history list */
 
             if (History[g][j].location != 0   /* if the next entry has already been used */
-            && j == Tuplehash[g][History[g][j].code]) {    /* check Tuplehash.  * If it still points here, */
-                Tuplehash[g][History[g][j].code] = 0;   /* zero it out.   */
+            && j == tuplehash_lookup(g, History[g][j].code)) {    /* check Tuplehash.  * If it still points here, */
+                tuplehash_store(g, History[g][j].code, 0);   /* zero it out.   */
 
             }
 
             Nextfreehistoryindex[g] = j;
 
-            Tuplehash[g][Tuplecode[g]] = h; /* store index of current tuple */
+            tuplehash_store(g, Tuplecode[g], h); /* store index of current tuple */
             History[g][h].location = i; /* store info about current tuple */
             History[g][h].previous = y;
             History[g][h].code = Tuplecode[g];
@@ -3620,122 +4553,7 @@ void newtupbo(void)
                     /* recall that the History lists do not exclude distance */
                     /* that are too short, only those that are too long  */
                     if (d > Tuplemaxdistance[g - 1]) {
-                        /* add tuplematch to Distance */
-                        add_tuple_match_to_Distance_entry(i, Tuplesize[g], d, Distance);
-
-                        /* check if this distance has already been processed */
-
-                        /* found=search_for_distance_match_in_distanceseenlist(d,i); */
-                        /* modified 5/23/05 G. Benson */
-                        found = search_for_distance_match_in_distanceseenarray(d, i);
-
-                        if (!found) {
-
-                            /* is distance d linked into other nonzero distances? */
-                            /* if not, link it in */
-                            if (!Distance[d].linked)
-                                link_Distance_window(d);
-
-                            /* test criteria for candidate */
-
-                            if ((new_meet_criteria_3(d, i, Tuplesize[g]))
-                            && (d <= 250 || search_for_range_in_bestperiodlist(i, d)))
-                                /* use bestperiod list only for distances greater than 500 */
-                            {
-                                /* align sequence against candidate and get alignment */
-                                WDPcount++;
-                                Criteria_count[d]++;
-                                Rows = 0;
-                                if (d <= SMALLDISTANCE) {
-                                    newwrap(i, d, WITHOUTCONSENSUS);
-                                    Cell_count[d] += (Rows * d);
-                                    get_pair_alignment_with_copynumber(d);
-                                }
-                                else {  /* d is a large distance */
-                                    if (1 % 100 == 0)
-                                        fprintf(stderr, "\ni=%d  d=%d", i, d);
-                                    narrowbandwrap(i, d, max(MINBANDRADIUS, d_range(d)), min(2 * max(MINBANDRADIUS,
-                                        d_range(d)), (d / 3)), WITHOUTCONSENSUS, RECENTERCRITERION);
-                                    Cell_count[d] += (Rows * (2 * max(MINBANDRADIUS, d_range(d)) + 1));
-                                    get_narrowband_pair_alignment_with_copynumber(d, min(2 * max(MINBANDRADIUS, d_range(d)),
-                                        (d / 3)), LOCAL);
-                                }
-
-                                if (Meet_criteria_print)
-                                    trf_message("\nFrom:%d, To:%d,  Copynumber:%f",
-                                        AlignPair.indexprime[AlignPair.length], AlignPair.indexprime[1], Copynumber);
-                                
-                                add_to_distanceseenarray(i, d, Maxrealrow, Maxscore);
-
-                                /*
-                                 * change to make number of copies required less restrictive for pattern sizes >= 50
-                                 * this ramps from 1.9 at pattern size = 50 down to 1.8 at pattern size = 100 or above */
-                                if ((d <= 50 && Copynumber < 1.9)
-                                    || (d > 50 && d <= 100 && Copynumber < 1.9 - 0.002 * (d - 50))
-                                    || (d > 100 && Copynumber < 1.8))
-                                    /* if(Copynumber<1.9) */
-                                    /* max(1.9,(double)Min_Distance_Window/(double)d)) */
-                                    /*  ceil((double)Min_Distance_Window/(double)d))) */
-                                    /* rationale for max here; Min_Distance_Window is the */
-                                    /* smallest actual tandem repeat we want to see, so */
-                                    /* divide by d to get minimum number of copies */
-                                {
-                                }
-                                else {
-                                    pass_multiples_test = multiples_criteria_4(d);
-                                    add_to_bestperiodlist(d);
-                                    if (pass_multiples_test) {
-
-                                        /* get consensus */
-                                        Classlength = d;
-                                        get_consensus(d);
-                                        if (ConsClasslength != Classlength)
-                                            Classlength = ConsClasslength;
-
-                                        /* repeat alignment using consensus */
-                                        Consensus_count[Classlength]++;
-                                        Rows = 0;
-                                        if (Classlength <= SMALLDISTANCE) {
-                                            newwrap(i, Classlength, WITHCONSENSUS);
-                                            Cell_count[Classlength] += (Rows * d);
-                                            get_pair_alignment_with_copynumber(Classlength);
-                                        }
-                                        else {  /* d is a large distance */
-                                            narrowbandwrap(i, Classlength,
-                                                max(MINBANDRADIUS, d_range(Classlength)),
-                                                min(2 * max(MINBANDRADIUS, d_range(Classlength)), (Classlength / 3)),
-                                                WITHCONSENSUS, RECENTERCRITERION);
-
-                                            Cell_count[Classlength] +=
-                                                (Rows * (2 * max(MINBANDRADIUS, d_range(Classlength)) + 1));
-                                            get_narrowband_pair_alignment_with_copynumber(Classlength,
-                                                min(2 * max(MINBANDRADIUS, d_range(Classlength)), (Classlength / 3)),
-                                                LOCAL);
-                                        }
-
-                                        add_to_distanceseenarray(i, d, Maxrealrow, Maxscore);
-                                        adjust_bestperiod_entry(d);
-
-                                        /* change to make number of copies required less restrictive for pattern sizes >= 50
-                                         * this ramps from 1.9 at pattern size = 50 down to 1.8 at pattern size = 100 or above */
-                                        if ((Classlength <= 50 && Copynumber < 1.9)
-                                        || (Classlength > 50 && Classlength <= 100 && Copynumber < 1.9 - 0.002 * (d - 50))
-                                        || (Classlength > 100 && Copynumber < 1.8))
-                                        {
-                                        }
-                                        else if (Classlength >= Minsize && AlignPair.score >= Minscore) {
-                                            /* output repeat */
-                                            OUTPUTcount++;
-                                            Outputsize_count[Classlength]++;
-
-                                            /* sequence */
-                                            trf_message("\nFound at i:%d original size:%d final size:%d", i, d, Classlength);
-                                            get_statistics(Classlength);
-                                        }
-                                    }
-                                }
-                            }
-                        }
+                        process_tuple_match(i, d, Tupleweight[g]);
                     }
                 }
             }
@@ -3750,6 +4568,9 @@ void newtupbo(void)
         SetProgressBar();
 
     free(Bandcenter);
+    free(Selfcomparebases);
+    free(Selfcomparebad);
+    Selfcomparebases = Selfcomparebad = NULL;
 }
 
 void trf_message(char *format, ...)
@@ -116,10 +116,12 @@ char debugbuffer[500];
 unsigned char EC[2 * (MAXPATTERNSIZECONSTANT + 1)];
 
 int *Index;
+unsigned char Validbase[256];   /* 1 for A, C, G and T in either case */
 int *ACGTcount;
 
 unsigned char *Sequence;
 int Length;
+int Sequenceoffset;             /* bases before Sequence[1] in the input, for -region */
 
 /* int S[MAXWRAPLENGTH+1][MAXPATTERNSIZE];*/
 int Delta;                      /* indel penalty */
@@ -148,15 +150,18 @@ struct pairalign {
     int *indexprime, *indexsecnd;
 } AlignPair;
 
+/* counts for one consensus position; odd positions are pattern
+ * characters, even positions the inserts between them */
+struct cons_count {
+    int A, C, G, T, dash;
+    int insert;                 /* times insert occurs */
+    int letters;                /* number of letters in all inserts */
+    int total;                  /* occurrences of a position */
+};
+
 struct cons_data {
     char pattern[2 * (MAXPATTERNSIZECONSTANT + 1)];
-    int A[2 * (MAXPATTERNSIZECONSTANT + 1)],
-        C[2 * (MAXPATTERNSIZECONSTANT + 1)],
-        G[2 * (MAXPATTERNSIZECONSTANT + 1)],
-        T[2 * (MAXPATTERNSIZECONSTANT + 1)],
-        dash[2 * (MAXPATTERNSIZECONSTANT + 1)],
-        insert[2 * (MAXPATTERNSIZECONSTANT + 1)],
-        letters[2 * (MAXPATTERNSIZECONSTANT + 1)], total[2 * (MAXPATTERNSIZECONSTANT + 1)];
+    struct cons_count count[2 * (MAXPATTERNSIZECONSTANT + 1)];
 } Consensus;
 
 struct bestperiodlistelement {
@@ -167,8 +172,14 @@ struct bestperiodlistelement {
     int best3;
     int best4;
     int best5;
-    struct bestperiodlistelement *next;
-} Bestperiodlist[1];
+};
+
+/* pooled best period entries, kept as a binary heap with the smallest
+ * indexhigh on top so that entries too far back come off first.
+ * Bestperiodnewest is the slot of the entry added last, or -1. */
+struct bestperiodlistelement *Bestperiodlist;
+int Bestperiodcount, Bestperiodsize;
+int Bestperiodnewest;
 
 struct distanceentry {
     int location;
@@ -184,6 +195,17 @@ struct distancelist {
     struct distanceentry *entry;
 } *Distance;
 
+/* alignment parameters by pattern size, filled in once per sequence by
+ * init_and_fill_coin_toss_stats2000_with_4tuplesizes. Sizes run up to
+ * 2*g_MAXDISTANCE+1, as a consensus may be longer than its distance. */
+struct alignplan {
+    int range;                  /* d_range(d) */
+    int bandradius;             /* max(MINBANDRADIUS, d_range(d)) */
+    int bandradiusforward;      /* min(2*bandradius, d/3) */
+    int narrowband;             /* aligned by narrowbandwrap, else newwrap */
+    double mincopynumber;       /* copies needed to keep an alignment */
+} *Alignplan;
+
 #define Lookratio .4
 
 /* created 5/23/05 G. Benson */
@@ -255,6 +277,8 @@ double Cell_total, Wasted_total;
 #define GLOBAL 0
 #define LOCAL 1
 
+struct seqregion;
+
 struct paramset {
     unsigned int ps_match;
     unsigned int ps_mismatch;
@@ -272,6 +296,19 @@ struct paramset {
     int ps_ngs;
     int ps_use_stdin;
     unsigned int ps_maxwraplength;
+    int ps_fast;                   /* -fast preset, see sizesfast */
+    int ps_tuplecount;             /* 0 unless a tuple schedule was given */
+    int ps_stream;                 /* scan long sequences in windows */
+    int ps_binary;                 /* .dat output as binary columns */
+    int ps_bedfile;                /* -bed */
+    int ps_gff3file;               /* -gff3 */
+    int ps_cigar;                  /* edit strings in the .dat output */
+    int ps_htmlzip;                /* HTML pages in one .html.zip */
+    int ps_tuplesizes[MAXTUPLESIZES];
+    int ps_tuplemasks[MAXTUPLESIZES];  /* 0, or a spaced seed */
+    int ps_tuplestarts[MAXTUPLESIZES];
+    struct seqregion *ps_regions;  /* from -region and -regions */
+    int ps_regioncount;            /* 0 to read the whole input */
 
     char ps_inputfilename[_MAX_PATH];  /* constant defined in stdlib */
     char ps_outputprefix[_MAX_PATH];
@@ -318,9 +355,17 @@ int Maxrealcol;
 /* new for 2Anewt */
 
 static const int four_to_the[] = {
-    1, 4, 16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576
+    1, 4, 16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576,
+    4194304, 16777216
 };
 
+/* largest tuple size; four_to_the must reach 4^MAXTUPLESIZE */
+#define MAXTUPLESIZE 12
+
+/* tuple weights up to this are looked up in a direct 4^k table, larger
+ * ones in a hash table keyed by tuple code */
+#define MAXDIRECTTUPLESIZE 10
+
 /* number of different tuple sizes to use; preset for all distances */
 int NTS;
 
@@ -329,6 +374,13 @@ int NTS;
 int Tuplesize[MAXTUPLESIZES + 1];
 int Tuplemaxdistance[MAXTUPLESIZES + 1];
 
+/* spaced seeds: Tuplesize is the span of the seed, Tuplemask has a bit
+ * set for each compared position (bit 0 is the newest) and Tupleweight
+ * is the number of compared positions. Tuplemask is 0 for plain tuples,
+ * whose weight equals their size. */
+int Tuplemask[MAXTUPLESIZES + 1];
+int Tupleweight[MAXTUPLESIZES + 1];
+
 /* this is where the actual tuple codes encountered
  * at a sequence location * are stored. */
 int Tuplecode[MAXTUPLESIZES + 1];   
@@ -336,6 +388,29 @@ int Tuplecode[MAXTUPLESIZES + 1];
 /* points to last location of code in history list */
 int *Tuplehash[MAXTUPLESIZES + 1];  
 
+/* replaces Tuplehash for tuple sizes over MAXDIRECTTUPLESIZE. Only codes
+ * with a live History entry are kept, so the table is sized from
+ * Historysize rather than 4^k. index 0 marks an empty slot. */
+struct tuplehashentry {
+    int code, index;
+} *Tuplehashtable[MAXTUPLESIZES + 1];
+
+/* log2 of the Tuplehashtable size; 0 if Tuplehash is used */
+int Tuplehashbits[MAXTUPLESIZES + 1];
+
+/* The smallest tuple size is found by comparing Sequence with itself
+ * shifted by each distance up to SELFCOMPAREMAXDISTANCE, instead of
+ * through Tuplehash, when its distances all fit. Selfcomparebases packs
+ * Sequence two bits per base, 32 bases per word, and Selfcomparebad
+ * marks the bases that are not ACGT; word 0 is padding before the
+ * sequence. Selfcomparehits[q] has bit d set if the tuple ending at
+ * position q of Selfcompareblock matches the one d positions back. */
+#define SELFCOMPAREMAXDISTANCE 31
+unsigned long long *Selfcomparebases, *Selfcomparebad;
+unsigned int Selfcomparehits[32];
+int Selfcompareblock;
+int Selfcomparemaxdistance;         /* 0 if tier 1 uses Tuplehash */
+
 /* size of history lists */
 int Historysize[MAXTUPLESIZES + 1]; 
 
@@ -372,6 +447,7 @@ int ldong;
 int *Statistics_Distance;
 
 FILE *Fptxt;
+int Alignmentmark;              /* of the repeat being reported, see MarkAlignment */
 FILE *Fpdat;
 
 int Minsize = 1;
@@ -397,11 +473,18 @@ struct fastasequence {
     int nucleotides;
     char name[MAXSEQNAMELEN];
     char *sequence;
+    unsigned int offset;        /* bases before sequence[0], for a region */
 
 };
 
 void trf_message(char *format, ...);
 
+struct index_list;
+
+/* Prints to fp the alignment text of a repeat whose printing was
+ * deferred, rebuilding its alignment from the edit string. */
+void PrintAlignmentRecord(FILE *fp, const struct index_list *entry);
+
 char* newAlignPairtext(int length);
 char* newLine(int length);
 int* newAlignPairindex(int length);
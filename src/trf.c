@@ -32,6 +32,8 @@ License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
 #include <limits.h>             // LONG_MIN, LONG_MAX
 #include "trfrun.h"
 #include "tr30dat.h"
+#include "tuplestats.h"
+#include "seqread.h"
 
 const char *usage = "\n\nPlease use: %s File Match Mismatch Delta PM PI Minscore MaxPeriod [options]\n"
     "\nWhere: (all weights, penalties, and scores are positive)"
@@ -55,7 +57,39 @@ const char *usage = "\n\nPlease use: %s File Match Mismatch Delta PM PI Minscore
     "\n                  Output is printed to the screen, not a file. You may pipe input in with"
     "\n                  this option using - for file name. Short 50 flanks are appended to .dat"
     "\n                  output."
-    "\n"
+    "\n        -fast     only use tuples of size 8, 10 and 12. Faster on sequence with few"
+    "\n                  repeats, but no faster on repeat-rich sequence, and repeats of"
+    "\n                  any period may be missed."
+    "\n        -tuples <size:distance,...>"
+    "\n                  tuple size (2 to 12) to use from each pattern distance on"
+    "\n                  (eg, -tuples 4:1,5:30,7:160). A size may be replaced by a spaced"
+    "\n                  seed, where 0 marks a position that may mismatch (eg, 11011011:160)."
+    "\n                  PM other than 75 and 80, or a schedule, makes TRF compute its own wait"
+    "\n                  and sum tables. These are cached in $TRF_CACHE_DIR, or $HOME/.trf."
+    "\n        -stream   scan long sequences in windows of 16 times the maximum TR length,"
+    "\n                  so memory does not grow with the sequence. Implies -h."
+    "\n        -binary   write the .dat output as binary columns (.dat.bin) that can be"
+    "\n                  mapped and read without parsing. Implies -d. trfdat converts the"
+    "\n                  file back to .dat text."
+    "\n        -bed      also write the repeats as BED features (.bed), with the period,"
+    "\n                  copies, score and consensus in extra columns."
+    "\n        -gff3     also write the repeats as GFF3 features (.gff3)."
+    "\n        -cigar    add the alignment of each repeat against its consensus to the .dat"
+    "\n                  output, as a run-length edit string (eg, 12=1X3=1I). Implies -d."
+    "\n        -zip      write the HTML pages into one uncompressed ZIP archive (.html.zip)"
+    "\n                  instead of separate files, for runs on many sequences."
+    "\n        -region <name:start-end>"
+    "\n                  only scan this part of a sequence (counting from 1, eg,"
+    "\n                  -region chr1:1,000,000-2,000,000), read through the .fai index of"
+    "\n                  the FASTA file. May be given more than once. Indices in the output"
+    "\n                  are those of the whole sequence."
+    "\n        -regions <file.bed>"
+    "\n                  as -region, for every interval of a BED file."
+    "\n";
+
+/* the rest of the usage message, kept apart so that neither string
+ * passes the length ISO C compilers must support */
+const char *usagenotes = "\n"
     "\nSee more information on the TRF Unix Help web page: https://tandem.bu.edu/trf/trf.unix.help.html"
     "\n"
     "\nNote the sequence file should be in FASTA format:"
@@ -90,6 +124,7 @@ int main(int ac, char **av)
     /* Expects exactly 8 non-option arguments */
     if (ac < 9) {
         fprintf(stderr, usage, av[0]);
+        fputs(usagenotes, stderr);
         exit(1);
     }
 
@@ -103,12 +138,23 @@ int main(int ac, char **av)
     g_paramset.ps_redundoff = 0;
     g_paramset.ps_maxwraplength = 2000000;
     g_paramset.ps_ngs = 0;           /* this is for unix systems only */
+    g_paramset.ps_fast = 0;
+    g_paramset.ps_tuplecount = 0;    /* use the tuple sizes of the PM tables */
+    g_paramset.ps_stream = 0;
+    g_paramset.ps_binary = 0;
+    g_paramset.ps_bedfile = 0;
+    g_paramset.ps_gff3file = 0;
+    g_paramset.ps_cigar = 0;
+    g_paramset.ps_htmlzip = 0;
+    g_paramset.ps_regions = NULL;    /* whole input */
+    g_paramset.ps_regioncount = 0;
 
     /* Parse command line options */
     /* Assume that since the first checks were passed, options start at argument 8
      * getopt ignores the first array element, so start at element 8 */
     char **opt_arr = &av[8];
     int remaining_opts = ac - 8;
+    int intervals;
 
     while (1) {
         static struct option long_options[] = {
@@ -123,6 +169,16 @@ int main(int ac, char **av)
             { "Ngs", no_argument, &g_paramset.ps_ngs, 1 },   /* -Ngs */
             { "NGS", no_argument, &g_paramset.ps_ngs, 1 },   /* -NGS */
             { "maxlength", required_argument, 0, 'l' }, /* -l, -L */
+            { "fast", no_argument, &g_paramset.ps_fast, 1 }, /* -fast */
+            { "tuples", required_argument, 0, 't' },    /* -tuples */
+            { "stream", no_argument, &g_paramset.ps_stream, 1 },    /* -stream */
+            { "binary", no_argument, &g_paramset.ps_binary, 1 },    /* -binary */
+            { "bed", no_argument, &g_paramset.ps_bedfile, 1 },  /* -bed */
+            { "gff3", no_argument, &g_paramset.ps_gff3file, 1 },    /* -gff3 */
+            { "cigar", no_argument, &g_paramset.ps_cigar, 1 },  /* -cigar */
+            { "zip", no_argument, &g_paramset.ps_htmlzip, 1 },  /* -zip */
+            { "region", required_argument, 0, 'g' },    /* -region */
+            { "regions", required_argument, 0, 'b' },   /* -regions */
             { 0, 0, 0, 0 }
         };
         /* getopt_long stores the option index here. */
@@ -156,6 +212,7 @@ int main(int ac, char **av)
             case 'u':
             case 'U':
                 printf(usage, av[0]);
+                fputs(usagenotes, stdout);
                 exit(0);
                 break;
 
@@ -198,7 +255,7 @@ int main(int ac, char **av)
                     exit(2);
                 }
 
-                if (ParseUInt(av[8], &g_paramset.ps_maxwraplength) == 0) {
+                if (ParseUInt(optarg, &g_paramset.ps_maxwraplength) == 0) {
                     fprintf(stderr, "Error while parsing max TR length (option '-L') value\n");
                     PrintBanner();
                     exit(1);
@@ -207,6 +264,42 @@ int main(int ac, char **av)
 
                 break;
 
+            case 't':
+                g_paramset.ps_tuplecount = ParseTupleSchedule(optarg, g_paramset.ps_tuplesizes,
+                    g_paramset.ps_tuplemasks, g_paramset.ps_tuplestarts, MAXTUPLESIZES);
+                if (g_paramset.ps_tuplecount == 0) {
+                    fprintf(stderr, "Error while parsing tuple schedule (option '-tuples') value\n");
+                    fprintf(stderr, "Expected increasing size:distance pairs, sizes %d to %d, first distance 1\n",
+                        TS_MINTUPLESIZE, TS_MAXTUPLESIZE);
+                    PrintBanner();
+                    exit(1);
+                }
+                break;
+
+            case 'g':
+                if (ParseSequenceRegion(optarg, &g_paramset.ps_regions, &g_paramset.ps_regioncount) < 0) {
+                    fprintf(stderr, "Error while parsing region (option '-region') value\n");
+                    fprintf(stderr, "Expected name, name:start or name:start-end, counting from 1\n");
+                    PrintBanner();
+                    exit(1);
+                }
+                break;
+
+            case 'b':
+                intervals = ReadSequenceRegions(optarg, &g_paramset.ps_regions, &g_paramset.ps_regioncount);
+                if (intervals < 0) {
+                    fprintf(stderr, "Error while reading BED file (option '-regions') %s\n", optarg);
+                    PrintBanner();
+                    exit(1);
+                }
+                /* without intervals the whole input would be scanned */
+                if (intervals == 0) {
+                    fprintf(stderr, "No intervals in BED file (option '-regions') %s\n", optarg);
+                    PrintBanner();
+                    exit(1);
+                }
+                break;
+
             case '?':
                 /* getopt_long already printed an error message. */
                 break;
@@ -233,6 +326,9 @@ int main(int ac, char **av)
     else if (ParseUInt(av[5], &g_paramset.ps_PM) == 0) {
         g_paramset.ps_endstatus = "Error parsing PM parameter." " Value must be a positive integer.";
     }
+    else if (g_paramset.ps_PM < TS_MINPM || g_paramset.ps_PM > TS_MAXPM) {
+        g_paramset.ps_endstatus = "Error parsing PM parameter." " Value must be between 51 and 99, inclusive.";
+    }
     else if (ParseUInt(av[6], &g_paramset.ps_PI) == 0) {
         g_paramset.ps_endstatus = "Error parsing PI parameter." " Value must be a positive integer.";
     }
@@ -250,8 +346,13 @@ int main(int ac, char **av)
         exit(1);
     }
 
+    /* -stream never holds a whole sequence, which the HTML output needs */
+    g_paramset.ps_HTMLoff |= g_paramset.ps_stream;
+
     // g_paramset.datafile must be set if HTMLoff is set
     g_paramset.ps_datafile |= g_paramset.ps_HTMLoff;
+    g_paramset.ps_datafile |= g_paramset.ps_binary;
+    g_paramset.ps_datafile |= g_paramset.ps_cigar;
 
     if (g_paramset.ps_ngs == 1) {
         g_paramset.ps_datafile = 1;
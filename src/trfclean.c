@@ -28,6 +28,7 @@ License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
 #include "trfrun.h"
 #include "tr30dat.h"
 #include "indexlist.h"
+#include "htmlzip.h"
 
 void TRFClean(const char *alignmentfile, const char *tablefile, int maxsize)
 {
@@ -46,8 +47,7 @@ void TRFClean(const char *alignmentfile, const char *tablefile, int maxsize)
     headptr = SortByCount(headptr);
 
     if (!g_paramset.ps_HTMLoff) {
-        CleanAlignments(headptr, alignmentfile);
-        BreakAlignments(headptr, alignmentfile);
+        WriteAlignments(headptr, alignmentfile);
         OutputHTML(headptr, tablefile, alignmentfile);
     }
 
@@ -118,6 +118,9 @@ struct index_list *GetList(const char *datafile)
             return NULL;
         }
         strcpy(newptr->il_pattern, patbuffer);
+        newptr->il_alignment = -1;
+        newptr->il_edits = NULL;
+        newptr->il_record = NULL;
 
         if (headptr == NULL) {  /* first element */
             headptr = lastptr = newptr;
@@ -146,14 +149,12 @@ struct index_list *RemoveBySize(struct index_list *headptr, int maxsize)
         if (currptr->il_period > maxsize) {    /* remove */
             if (currptr == headptr) {
                 headptr = headptr->il_next;
-                free(currptr->il_pattern);
-                free(currptr);
+                FreeListEntry(currptr);
                 currptr = headptr;
             }
             else {
                 prevptr->il_next = currptr->il_next;
-                free(currptr->il_pattern);
-                free(currptr);
+                FreeListEntry(currptr);
                 currptr = prevptr->il_next;
             }
 
@@ -257,8 +258,7 @@ struct index_list *RemoveRedundancy(struct index_list *headptr)
                 /* remove iptr and break from inner loop */
                 if (iptr == headptr) {
                     headptr = headptr->il_next;
-                    free(iptr->il_pattern);
-                    free(iptr);
+                    FreeListEntry(iptr);
                     iptr = headptr;
                     jptr = iptr->il_next;
                     prevjptr = iptr;
@@ -266,8 +266,7 @@ struct index_list *RemoveRedundancy(struct index_list *headptr)
                 }
                 else {
                     previptr->il_next = iptr->il_next;
-                    free(iptr->il_pattern);
-                    free(iptr);
+                    FreeListEntry(iptr);
                     iptr = previptr->il_next;
                     jptr = iptr->il_next;
                     prevjptr = iptr;
@@ -279,8 +278,7 @@ struct index_list *RemoveRedundancy(struct index_list *headptr)
             if (!(overlap / (double)jinterval < 0.9) && IsRedundant(jptr, iptr)) {
                 /* remove jptr and continue next iteration of inner loop */
                 prevjptr->il_next = jptr->il_next;
-                free(jptr->il_pattern);
-                free(jptr);
+                FreeListEntry(jptr);
                 jptr = prevjptr->il_next;
                 continue;
             }
@@ -369,85 +367,87 @@ struct index_list *SortByCount(struct index_list *headptr)
     return headptr;
 }
 
-void CleanAlignments(struct index_list *headptr, const char *alignmentfile)
+/* the alignment text of the current sequence, see StartAlignmentText */
+static char *Alignmenttext;
+static size_t Alignmentsize;
+static size_t Alignmentend;         /* length of the text, once ended */
+static struct alignmentmark {
+    size_t start;                   /* where the text of a repeat starts */
+    size_t slot;                    /* where its deferred alignment goes */
+} *Alignmentmarks;
+static int Alignmentmarkcount;
+static int Alignmentmarkalloc;
+
+void StartAlignmentText(void)
 {
-    char string1[260];
-    char string2[260];
-    char string3[260];
-    char tempfile[264];
-    FILE *al_fp, *tmp_fp;
-    struct index_list *currptr;
-    int moving;                 /* in loop moving=1 to copy strings to tempfile */
-
-    /* execute even if no repeats in list */
-
-    /* make name of temporary file */
-    strcpy(tempfile, alignmentfile);
-    strcat(tempfile, ".tmp");
-
-    /* open files */
-    al_fp = fopen(alignmentfile, "r");
-    if (al_fp == NULL)
-        die("Unable to open alignment file for reading in CleanAlignments routine!");
-    
-    tmp_fp = fopen(tempfile, "w");
-    if (tmp_fp == NULL)
-        die("Unable to open temp file for writing in CleanAlignments routine!");
+    Alignmentmarkcount = 0;
+    Fptxt = open_memstream(&Alignmenttext, &Alignmentsize);
+    if (Fptxt == NULL)
+        die("Unable to allocate memory for alignment text in StartAlignmentText routine!");
+}
 
-    moving = 1;                 /* starts by moving lines to temporary file */
-    currptr = headptr;
-    while (fgets(string1, 260, al_fp) != NULL) {
-        if (string1[0] == 'F' /* Gelfand Dec 15, 2013 */  && string1[1] == 'o') {   /* Ocurrs when "Found at" is encountered */
-            fgets(string2, 260, al_fp);
-            fgets(string3, 260, al_fp);
-            if (currptr != NULL) {
-                if (strstr(string3, currptr->il_ref) != NULL) {
-                    fputs(string1, tmp_fp);
-                    fputs(string2, tmp_fp);
-                    fputs(string3, tmp_fp);
-                    currptr = currptr->il_next;
-                    moving = 1;
-                    continue;
-                }
-            }
-            moving = 0;
-        }
+/* Returns the number of the mark set at the end of the text so far, or -1
+ * without HTML output. */
+int MarkAlignment(void)
+{
+    struct alignmentmark *grown;
+    long offset;
+
+    if (g_paramset.ps_HTMLoff)
+        return -1;
+
+    if (Alignmentmarkcount == Alignmentmarkalloc) {
+        Alignmentmarkalloc = Alignmentmarkalloc ? 2 * Alignmentmarkalloc : 256;
+        grown = realloc(Alignmentmarks, Alignmentmarkalloc * sizeof *Alignmentmarks);
+        if (grown == NULL)
+            die("Unable to allocate memory for alignment marks in MarkAlignment routine!");
+        Alignmentmarks = grown;
+    }
 
-        if (string1[0] == 'D' /* Gelfand Dec 15, 2013 */  && string1[1] == 'o') {   /* Occurs when "Done." is encountered */
-            fgets(string2, 260, al_fp);
-            fputs(string1, tmp_fp);
-            fputs(string2, tmp_fp);
-            fputs("\n", tmp_fp);
-            break;
-        }
+    offset = ftell(Fptxt);
+    if (offset < 0)
+        die("Unable to write alignment text in MarkAlignment routine!");
+    Alignmentmarks[Alignmentmarkcount].start = (size_t)offset;
+    Alignmentmarks[Alignmentmarkcount].slot = (size_t)offset;
+    return Alignmentmarkcount++;
+}
 
-        if (moving)
-            fputs(string1, tmp_fp);
-    }
+void SetAlignmentSlot(int mark)
+{
+    long offset;
 
-    fclose(al_fp);
-    fclose(tmp_fp);
+    if (mark < 0)
+        return;
 
-    remove(alignmentfile);
-    rename(tempfile, alignmentfile);
+    offset = ftell(Fptxt);
+    if (offset < 0)
+        die("Unable to write alignment text in SetAlignmentSlot routine!");
+    Alignmentmarks[mark].slot = (size_t)offset;
+}
 
-    return;
+void EndAlignmentText(void)
+{
+    if (fclose(Fptxt) != 0)
+        die("Unable to write alignment text in EndAlignmentText routine!");
+    Fptxt = NULL;
+    Alignmentend = Alignmentsize;
+}
 
+void FreeAlignmentText(void)
+{
+    free(Alignmenttext);
+    Alignmenttext = NULL;
+    Alignmentsize = Alignmentend = 0;
+    Alignmentmarkcount = 0;
 }
 
-void BreakAlignments(struct index_list *headptr, const char *alignmentfile)
+void WriteAlignments(struct index_list *headptr, const char *alignmentfile)
 {
-    FILE *al_fp;
     FILE *out_fp;
     char outfile[260];
-    int nfiles;
     struct index_list *currptr;
-    int alignments;
-    char headlns[30][200];      /* to hold the heading section of the file */
-    char buffer[200];           /* holds one line of alignment data */
-    int headcnt;
-    char nextchar;
-    int i, j;
+    size_t heading, start, slot, end;
+    int alignments, nfiles, i, j, k;
 
     /* Find out how many alignments there are and how many files will
      * be needed */
@@ -458,87 +458,46 @@ void BreakAlignments(struct index_list *headptr, const char *alignmentfile)
     if (nfiles == 0)
         nfiles = 1;             /* make sure at least one file is generated */
 
-    /* if only one file will be needed just rename file */
-    if (nfiles == 1) {
-        MakeFileName(outfile, alignmentfile, 1);
-        remove(outfile);
-        rename(alignmentfile, outfile);
-        return;
-    }
+    /* the heading is everything before the first repeat */
+    heading = Alignmentmarkcount > 0 ? Alignmentmarks[0].start : Alignmentend;
 
-    /* get heading lines */
-    al_fp = fopen(alignmentfile, "r");
-    if (al_fp == NULL)
-        die("Unable to open alignment file for reading in BreakAlignments routine!");
-
-    for (i = 0, headcnt = 0; i < 30; i++) {
-        /* find if next line is the "Found at" line */
-        nextchar = getc(al_fp);
-        ungetc(nextchar, al_fp);
-        if (nextchar == 'F')
-            break;
-        fgets(headlns[i], 200, al_fp);
-        headcnt++;
-    }
-
-    /* loop creating files */
+    currptr = headptr;
     for (i = 1; i <= nfiles; i++) {
-        /* create name of ith file */
         MakeFileName(outfile, alignmentfile, i);
-        /* open the file for writing */
-        out_fp = fopen(outfile, "w");
+        out_fp = OpenHTMLPage(outfile);
         if (out_fp == NULL)
-            die("Unable to open output file for writing in BreakAlignments routine!");
+            die("Unable to open output file for writing in WriteAlignments routine!");
 
-        /* output heading */
-        for (j = 0; j < headcnt; j++)
-            fputs(headlns[j], out_fp);
-        /* output n of N identifier */
-        //fprintf(out_fp,"File %d of %d\n\n",i+1,nfiles);
-        fprintf(out_fp, "File %d of %d\n\n", i, nfiles);
-
-        /*move alignments to the current output file */
-        for (j = 0; j < EO_MAX_TBL; j++) {
-            /* copy the first line of the alignment */
-            fgets(buffer, 200, al_fp);
-            fputs(buffer, out_fp);
-            /* copy successive lines checking for the "Found at" and
-             * the "Done." lines */
-            while (1) {
-                nextchar = getc(al_fp);
-                ungetc(nextchar, al_fp);
-                if (nextchar == 'F' || nextchar == 'D')
-                    break;
-
-                // added check for NULL, Gelfand Dec 15, 2013 because of suspicion this may under
-                // certain conditions enter an infinite loop.
-                if (NULL == fgets(buffer, 200, al_fp)) {
-                    nextchar = 'D';
-                    break;
-                }
+        fwrite(Alignmenttext, 1, heading, out_fp);
+        if (nfiles > 1)
+            fprintf(out_fp, "File %d of %d\n\n", i, nfiles);
 
-                fputs(buffer, out_fp);
-            }
-            if (nextchar == 'F')
+        for (j = 0; j < EO_MAX_TBL && currptr != NULL; j++, currptr = currptr->il_next) {
+            k = currptr->il_alignment;
+            if (k < 0)
                 continue;
-            if (nextchar == 'D')
-                break;
+            start = Alignmentmarks[k].start;
+            slot = Alignmentmarks[k].slot;
+            end = k + 1 < Alignmentmarkcount ? Alignmentmarks[k + 1].start : Alignmentend;
+
+            /* the alignment itself is only printed now that it is kept */
+            fwrite(Alignmenttext + start, 1, slot - start, out_fp);
+            if (currptr->il_record != NULL)
+                PrintAlignmentRecord(out_fp, currptr);
+            fwrite(Alignmenttext + slot, 1, end - slot, out_fp);
         }
 
         /* Output closing Lines */
-        fprintf(out_fp, "\nDone.\n</PRE></BODY></HTML>\n");
+        if (nfiles > 1)
+            fprintf(out_fp, "\nDone.\n</PRE></BODY></HTML>\n");
+        else
+            fprintf(out_fp, "Done.\n</PRE></BODY></HTML>\n");
 
-        /*close file */
-        fclose(out_fp);
+        if (CloseHTMLPage(out_fp) != 0)
+            die("Unable to write output file in WriteAlignments routine!");
     }
 
-    /*close original file */
-    fclose(al_fp);
-
-    /* delete original file */
-    remove(alignmentfile);
-
-    return;
+    FreeAlignmentText();
 }
 
 void MakeFileName(char *newname, const char *oldname, int tag)
@@ -613,7 +572,7 @@ void OutputHTML(struct index_list *headptr, const char *tablefile, const char *a
         MakeFileName(linkfile, alignmentfile, i);
 
         /* open the file for writing */
-        fp = fopen(outfile, "w");
+        fp = OpenHTMLPage(outfile);
         if (fp == NULL)
             die("Unable to open output file for writing in OutputHTML routine!");
 
@@ -655,7 +614,8 @@ void OutputHTML(struct index_list *headptr, const char *tablefile, const char *a
                     "<TR><TD WIDTH=140><CENTER>Indices</CENTER></TD><TD WIDTH=80><CENTER>Period<BR>Size </CENTER></TD><TD WIDTH=70><CENTER>Copy<BR>Number</CENTER></TD><TD WIDTH=70><CENTER>Consensus<BR>Size</CENTER></TD><TD WIDTH=70><CENTER>Percent<BR>Matches</CENTER></TD><TD WIDTH=70><CENTER>Percent<BR>Indels</CENTER></TD><TD WIDTH=60><CENTER>Score</CENTER></TD><TD WIDTH=40><CENTER>A</CENTER></TD><TD WIDTH=40><CENTER>C</CENTER></TD><TD WIDTH=40><CENTER>G</CENTER></TD><TD WIDTH=40><CENTER>T</CENTER></TD><TD WIDTH=70><CENTER>Entropy<BR>(0-2)</CENTER></TD></TR>\n");
             fprintf(fp,
                 "<TR><TD><CENTER><A HREF=\"%s#%s\">%d--%d</A></CENTER></TD><TD><CENTER>%d</CENTER></TD><TD><CENTER>%1.1f</CENTER></TD><TD><CENTER>%d</CENTER></TD><TD><CENTER>%d</CENTER></TD><TD><CENTER>%d</CENTER></TD><TD><CENTER>%d</CENTER></TD><TD><CENTER>%d</CENTER></TD><TD><CENTER>%d</CENTER></TD><TD><CENTER>%d</CENTER></TD><TD><CENTER>%d</CENTER></TD><TD><CENTER>%1.2f</CENTER></TD></TR>\n",
-                linkfile, currptr->il_ref, currptr->il_first, currptr->il_last, currptr->il_period, currptr->il_copies, currptr->il_size,
+                linkfile, currptr->il_ref, currptr->il_first + Sequenceoffset, currptr->il_last + Sequenceoffset,
+                currptr->il_period, currptr->il_copies, currptr->il_size,
                 currptr->il_matches, currptr->il_indels, currptr->il_score, currptr->il_acount, currptr->il_ccount, currptr->il_gcount,
                 currptr->il_tcount, currptr->il_entropy);
         }
@@ -693,7 +653,7 @@ void OutputHTML(struct index_list *headptr, const char *tablefile, const char *a
             fprintf(fp, "<P>The End!\n");
 
         fprintf(fp, "\n</BODY></HTML>\n");
-        fclose(fp);
+        CloseHTMLPage(fp);
     }
 }
 
@@ -718,7 +678,7 @@ void MakeDataFile(struct index_list *headptr, const char *datafile, int data)
 
         for (lpointer = headptr; lpointer != NULL; lpointer = lpointer->il_next) {
             fprintf(fp, "%d %d %d %.1f %d %d %d %d %d %d %d %d %.2f %s ",
-                lpointer->il_first, lpointer->il_last, lpointer->il_period,
+                lpointer->il_first + Sequenceoffset, lpointer->il_last + Sequenceoffset, lpointer->il_period,
                 lpointer->il_copies, lpointer->il_size, lpointer->il_matches,
                 lpointer->il_indels, lpointer->il_score, lpointer->il_acount,
                 lpointer->il_ccount, lpointer->il_gcount, lpointer->il_tcount, lpointer->il_entropy, lpointer->il_pattern);
@@ -735,39 +695,3 @@ void MakeDataFile(struct index_list *headptr, const char *datafile, int data)
         remove(datafile);
 }
 
-void MakeMaskedFile(struct index_list *headptr, int masked, unsigned char *Sequence, const char *maskfile)
-{
-    int count, printcr;
-    int masker;
-    FILE *fp;
-    struct index_list *lpointer;
-
-    if (masked) {
-        fp = fopen(maskfile, "w");
-        if (fp == NULL)
-            die("Unable to open output file for writing in MakeMaskedFile routine!");
-
-        /* Ouput sequence description from global variable to file */
-        fprintf(fp, ">%s", &hsequence[10]);
-
-        for (lpointer = headptr; lpointer != NULL; lpointer = lpointer->il_next) {
-            for (masker = lpointer->il_first; masker <= lpointer->il_last; masker++)
-                Sequence[masker] = 'N';
-        }
-        printcr = 0;
-        for (count = 1; Sequence[count] != '\0'; count++) {
-            fputc(Sequence[count], fp);
-            printcr++;
-            if (printcr >= 60) {
-                printcr = 0;
-                fputc('\n', fp);
-            }
-        }
-        fputc('\n', fp);
-        fputc('\n', fp);
-        fclose(fp);
-    }
-
-    return;
-}
-
@@ -36,10 +36,9 @@ License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
  *           original order.
  *   iv.     Remove redundant elements based on given criteria.
  *   v.      Sort remaining elements back to original order.
- *   vi.     In the Alignment file remove sections that correspond
- *           to records deleted in ii and iv.
- *   vii.    Break alignment file in a many files including a
- *           maximun number of alignments per file.
+ *   vi.     Write the alignments of the remaining elements, kept
+ *           in memory during the scan, to as many files as needed
+ *           for a maximun number of alignments per file.
  *   vii.    Save all remaining elements in HTML format. Creating
  *           as many files as necesary.
  *   viii.   Delete old data file and make new one if option is
@@ -70,11 +69,25 @@ struct index_list *RemoveBySize(struct index_list * headptr, int maxsize);
 struct index_list *SortByIndex(struct index_list * headptr);
 struct index_list *RemoveRedundancy(struct index_list * headptr);
 struct index_list *SortByCount(struct index_list * headptr);
-void CleanAlignments(struct index_list * headptr, const char *alignmentfile);
-void BreakAlignments(struct index_list * headptr, const char *alignmentfile);
+
+/* The alignment file is kept in memory while a sequence is scanned:
+ * StartAlignmentText points Fptxt at it, MarkAlignment is called where
+ * the text of each repeat starts, and EndAlignmentText closes it. The
+ * text of a repeat runs from its mark to the next one, so it includes
+ * any messages printed before the next repeat, as it did in the file.
+ * SetAlignmentSlot records where in that text the alignment of a repeat
+ * with an il_record is printed, once it is known to be kept. */
+void StartAlignmentText(void);
+int MarkAlignment(void);
+void SetAlignmentSlot(int mark);
+void EndAlignmentText(void);
+void FreeAlignmentText(void);
+
+/* Writes the heading and the alignments of the repeats in headptr,
+ * EO_MAX_TBL to a file, and frees the alignment text. */
+void WriteAlignments(struct index_list * headptr, const char *alignmentfile);
 void OutputHTML(struct index_list * headptr, const char *tablefile, const char *alignmentfile);
 void MakeDataFile(struct index_list * headptr, const char *datafile, int data);
-void MakeMaskedFile(struct index_list * headptr, int masked, unsigned char *Sequence, const char *maskfile);
 
 void FreeList(struct index_list * headptr);
 
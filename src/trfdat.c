@@ -0,0 +1,121 @@
+/*
+Tandem Repeats Finder
+Copyright (C) 1999-2020 Gary Benson
+
+This file is part of the Tandem Repeats Finder (TRF) program.
+
+TRF is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+TRF is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public
+License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/****************************************************************
+ *
+ *   TRFDAT.C : Converts a binary .dat file back to .dat text
+ *
+ *****************************************************************
+ *   usage: trfdat <file.dat.bin>, or - to read standard input.
+ *   The text is written to standard output, and is the .dat file
+ *   TRF would have written without -binary.
+ *****************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "datfile.h"
+
+/* Reads all of fp, for input that cannot be mapped. */
+static unsigned char *read_all(FILE *fp, size_t *size)
+{
+    unsigned char *data = NULL, *grown;
+    size_t allocated = 0, n;
+
+    *size = 0;
+    for (;;) {
+        if (*size == allocated) {
+            allocated = allocated ? 2 * allocated : 65536;
+            grown = realloc(data, allocated);
+            if (grown == NULL) {
+                free(data);
+                return NULL;
+            }
+            data = grown;
+        }
+        n = fread(data + *size, 1, allocated - *size, fp);
+        if (n == 0)
+            break;
+        *size += n;
+    }
+
+    if (ferror(fp)) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+int main(int ac, char **av)
+{
+    FILE *fp;
+    struct stat st;
+    unsigned char *data;
+    void *map = MAP_FAILED;
+    size_t size = 0;
+    int status;
+
+    if (ac != 2) {
+        fprintf(stderr, "Usage: %s <file.dat.bin>\n\nWrites the .dat text of a file made by trf -binary.\n", av[0]);
+        exit(1);
+    }
+
+    fp = strcmp(av[1], "-") == 0 ? stdin : fopen(av[1], "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "Error opening %s\n", av[1]);
+        exit(1);
+    }
+
+    if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+        && (unsigned long long)st.st_size <= (size_t)-1) {
+        size = (size_t)st.st_size;
+        map = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+    }
+    if (map != MAP_FAILED) {
+        data = map;
+    }
+    else {
+        data = read_all(fp, &size);
+        if (data == NULL) {
+            fprintf(stderr, "Error reading %s\n", av[1]);
+            exit(1);
+        }
+    }
+
+    status = ConvertDatBinary(data, size, stdout);
+    if (status < 0)
+        fprintf(stderr, "%s is not a binary .dat file\n", av[1]);
+
+    if (map != MAP_FAILED)
+        munmap(map, size);
+    else
+        free(data);
+    if (fp != stdin)
+        fclose(fp);
+
+    if (fflush(stdout) != 0) {
+        fprintf(stderr, "Error writing output\n");
+        exit(1);
+    }
+    return status < 0 ? 1 : 0;
+}
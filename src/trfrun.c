@@ -26,17 +26,476 @@ License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
 #include "tr30dat.h"
 #include "trfclean.h"
 #include "indexlist.h"
+#include "seqread.h"
+#include "outbuf.h"
+#include "datfile.h"
+#include "htmlzip.h"
+
+/* collects the .dat lines, see print_dat_records */
+static struct outbuf Datbuffer;
+
+/* the .dat file being written with -binary, see print_dat_banner */
+static struct datbinary *Datbinary;
+
+static void get_dat_parameters(unsigned int *parameters)
+{
+    parameters[0] = g_paramset.ps_match;
+    parameters[1] = g_paramset.ps_mismatch;
+    parameters[2] = g_paramset.ps_indel;
+    parameters[3] = g_paramset.ps_PM;
+    parameters[4] = g_paramset.ps_PI;
+    parameters[5] = g_paramset.ps_minscore;
+    parameters[6] = g_paramset.ps_maxperiod;
+}
+
+/* Opens prefix.paramstring.dat, or .dat.bin with -binary, naming it in destd. */
+static FILE *open_dat_file(char *destd, const char *prefix, const char *paramstring)
+{
+    if (g_paramset.ps_binary) {
+        sprintf(destd, "%s.%s.dat.bin", prefix, paramstring);
+        return fopen(destd, "wb");
+    }
+
+    sprintf(destd, "%s.%s.dat", prefix, paramstring);
+    return fopen(destd, "w");
+}
+
+/* Starts the .dat file: the banner, or the binary columns with -binary. */
+static void print_dat_banner(FILE *destdfp)
+{
+    unsigned int parameters[7];
+
+    if (g_paramset.ps_binary) {
+        get_dat_parameters(parameters);
+        Datbinary = CreateDatBinary(destdfp, parameters, versionstring, g_paramset.ps_ngs,
+            g_paramset.ps_cigar);
+        if (Datbinary == NULL)
+            die("Unable to create temporary files for binary data file in print_dat_banner routine!");
+    }
+    else if (g_paramset.ps_ngs != 1) {
+        InitOutputBuffer(&Datbuffer, destdfp);
+        OutputDatBanner(&Datbuffer, versionstring);
+        FlushOutputBuffer(&Datbuffer);
+    }
+}
+
+/* Starts the records of a sequence in the .dat file. */
+static void print_dat_sequence(FILE *destdfp, const char *name)
+{
+    unsigned int parameters[7];
+
+    if (Datbinary) {
+        AddDatBinarySequence(Datbinary, name);
+        return;
+    }
+
+    get_dat_parameters(parameters);
+    InitOutputBuffer(&Datbuffer, destdfp);
+    OutputDatSequence(&Datbuffer, name, parameters, g_paramset.ps_ngs);
+    FlushOutputBuffer(&Datbuffer);
+}
+
+/* Writes out a binary .dat file. The file itself is closed by the caller. */
+static void finish_dat_file(void)
+{
+    if (Datbinary == NULL)
+        return;
+
+    if (FinishDatBinary(Datbinary) < 0)
+        PrintError("Error writing binary data file.");
+    Datbinary = NULL;
+}
+
+/* Fills record with the fields of a repeat, without flanks or edits. */
+static void get_dat_record(struct datrecord *record, const struct index_list *lpointer)
+{
+    record->first = lpointer->il_first + Sequenceoffset;
+    record->last = lpointer->il_last + Sequenceoffset;
+    record->period = lpointer->il_period;
+    record->copies = lpointer->il_copies;
+    record->size = lpointer->il_size;
+    record->matches = lpointer->il_matches;
+    record->indels = lpointer->il_indels;
+    record->score = lpointer->il_score;
+    record->acount = lpointer->il_acount;
+    record->ccount = lpointer->il_ccount;
+    record->gcount = lpointer->il_gcount;
+    record->tcount = lpointer->il_tcount;
+    record->entropy = lpointer->il_entropy;
+    record->pattern = lpointer->il_pattern;
+    record->sequence = (char *)Sequence + lpointer->il_first;
+    record->sequencelength = lpointer->il_last - lpointer->il_first + 1;
+    record->leftflank = record->rightflank = NULL;
+    record->edits = NULL;
+}
+
+/* Prints the .dat lines of the repeats in list that start after lo and
+ * no later than hi, with short flanks in -ngs mode. */
+static void print_dat_records(FILE *destdfp, struct index_list *list, int lo, int hi)
+{
+    struct index_list *lpointer;
+    struct datrecord record;
+    int flankstart, flankend;
+
+    InitOutputBuffer(&Datbuffer, destdfp);
+
+    for (lpointer = list; lpointer != NULL; lpointer = lpointer->il_next) {
+        if (lpointer->il_first <= lo || lpointer->il_first > hi)
+            continue;
+
+        get_dat_record(&record, lpointer);
+
+        /* print short flanks to .dat file */
+        if (g_paramset.ps_ngs) {
+            flankstart = lpointer->il_first - 50;
+            flankstart = max(1, flankstart);
+            flankend = lpointer->il_last + 50;
+            flankend = min(Length, flankend);
+
+            if (lpointer->il_first == 1) {
+                record.leftflank = ".";
+                record.leftlength = 1;
+            }
+            else {
+                record.leftflank = (char *)Sequence + flankstart;
+                record.leftlength = lpointer->il_first - flankstart;
+            }
+
+            if (lpointer->il_last == Length) {
+                record.rightflank = ".";
+                record.rightlength = 1;
+            }
+            else {
+                record.rightflank = (char *)Sequence + lpointer->il_last + 1;
+                record.rightlength = flankend - lpointer->il_last;
+            }
+        }
+
+        if (g_paramset.ps_cigar && lpointer->il_edits != NULL)
+            record.edits = lpointer->il_edits;
+
+        if (Datbinary)
+            AddDatBinaryRecord(Datbinary, &record);
+        else
+            OutputDatRecord(&Datbuffer, &record);
+    }
+
+    FlushOutputBuffer(&Datbuffer);
+}
+
+/* the -bed and -gff3 files, or NULL */
+static FILE *Bedfp, *Gfffp;
+
+/* Opens prefix.paramstring.bed and .gff3 as requested. */
+static void open_feature_files(const char *prefix, const char *paramstring)
+{
+    char name[_MAX_PATH];
+
+    if (g_paramset.ps_bedfile) {
+        sprintf(name, "%s.%s.bed", prefix, paramstring);
+        Bedfp = fopen(name, "w");
+        if (Bedfp == NULL)
+            die("Unable to open BED file for writing in open_feature_files routine!");
+    }
+
+    if (g_paramset.ps_gff3file) {
+        sprintf(name, "%s.%s.gff3", prefix, paramstring);
+        Gfffp = fopen(name, "w");
+        if (Gfffp == NULL)
+            die("Unable to open GFF3 file for writing in open_feature_files routine!");
+        InitOutputBuffer(&Datbuffer, Gfffp);
+        OutputGffHeader(&Datbuffer);
+        FlushOutputBuffer(&Datbuffer);
+    }
+}
+
+static void close_feature_files(void)
+{
+    if (Bedfp) {
+        fclose(Bedfp);
+        Bedfp = NULL;
+    }
+    if (Gfffp) {
+        fclose(Gfffp);
+        Gfffp = NULL;
+    }
+}
+
+/* Finishes the -zip archive, if there is one. */
+static void close_html_zip(void)
+{
+    if (CloseHTMLZip() < 0)
+        PrintError("Error writing HTML archive.");
+}
+
+/* Writes the repeats in list that start after lo and no later than hi
+ * to the BED and GFF3 files, as features of the sequence called name. */
+static void print_feature_records(struct index_list *list, int lo, int hi, const char *name)
+{
+    char seqid[MAXSEQNAMELEN];
+    struct index_list *lpointer;
+    struct datrecord record;
+    FILE *fp;
+    char *p;
+    int pass;
+
+    /* the first word of the name, without the :start-end of a region */
+    strcpy(seqid, name);
+    seqid[strcspn(seqid, " \t")] = '\0';
+    if (g_paramset.ps_regioncount > 0 && (p = strrchr(seqid, ':')) != NULL)
+        *p = '\0';
+
+    for (pass = 0; pass < 2; pass++) {
+        fp = pass == 0 ? Bedfp : Gfffp;
+        if (fp == NULL)
+            continue;
+
+        InitOutputBuffer(&Datbuffer, fp);
+        for (lpointer = list; lpointer != NULL; lpointer = lpointer->il_next) {
+            if (lpointer->il_first <= lo || lpointer->il_first > hi)
+                continue;
+
+            get_dat_record(&record, lpointer);
+            if (pass == 0)
+                OutputBedRecord(&Datbuffer, seqid, &record);
+            else
+                OutputGffRecord(&Datbuffer, seqid, &record);
+        }
+        FlushOutputBuffer(&Datbuffer);
+    }
+}
+
+/* letters per line of the masked file */
+#define MASKLINE 60
+
+/* a repeat to mask in the window being written */
+struct maskspan {
+    int first, last;
+};
+
+static int compare_maskspans(const void *a, const void *b)
+{
+    return ((const struct maskspan *)a)->first - ((const struct maskspan *)b)->first;
+}
+
+/* Writes Sequence[lo+1..hi] to the masked file, with every repeat in list
+ * replaced by Ns, in lines of MASKLINE letters. Sequence itself is left
+ * alone, since the next window starts with the end of this one, and the
+ * stretches between the starts and ends of repeats are copied whole.
+ * *printcr counts the letters on the current line. */
+static void print_masked_window(FILE *destmfp, struct index_list *list, int lo, int hi, int *printcr)
+{
+    static char ns[MASKLINE];
+    struct index_list *lpointer;
+    struct maskspan *spans;
+    int n, s, k, end, span, masked, maskend;
+
+    for (n = 0, lpointer = list; lpointer != NULL; lpointer = lpointer->il_next)
+        n++;
+    spans = malloc((n + 1) * sizeof *spans);
+    if (spans == NULL)
+        die("Unable to allocate memory for masked file in print_masked_window routine!");
+
+    for (n = 0, lpointer = list; lpointer != NULL; lpointer = lpointer->il_next) {
+        spans[n].first = lpointer->il_first;
+        spans[n].last = lpointer->il_last;
+        n++;
+    }
+    qsort(spans, n, sizeof *spans, compare_maskspans);
+
+    if (ns[0] != 'N')
+        memset(ns, 'N', sizeof ns);
+    InitOutputBuffer(&Datbuffer, destmfp);
+
+    maskend = 0;
+    for (s = 0, k = lo + 1; k <= hi;) {
+        while (s < n && spans[s].first <= k) {
+            maskend = max(maskend, spans[s].last);
+            s++;
+        }
+
+        /* the stretch up to the next start or end of a repeat */
+        masked = (k <= maskend);
+        if (masked)
+            end = maskend;
+        else
+            end = s < n ? spans[s].first - 1 : hi;
+        end = min(end, hi);
+
+        while (k <= end) {
+            span = min(end - k + 1, MASKLINE - *printcr);
+            OutputSpan(&Datbuffer, masked ? ns : (char *)Sequence + k, span);
+            k += span;
+            *printcr += span;
+            if (*printcr >= MASKLINE) {
+                *printcr = 0;
+                OutputChar(&Datbuffer, '\n');
+            }
+        }
+    }
+
+    FlushOutputBuffer(&Datbuffer);
+    free(spans);
+}
+
+/* Writes the whole of Sequence to the masked file as the record called
+ * name, with every repeat in list replaced by Ns. */
+static void print_masked_sequence(FILE *destmfp, struct index_list *list, const char *name)
+{
+    int printcr = 0;
+
+    fprintf(destmfp, ">%s\n", name);
+    print_masked_window(destmfp, list, 0, Length, &printcr);
+    fputc('\n', destmfp);
+    fputc('\n', destmfp);
+}
+
+/* The -stream routine. Each sequence is scanned in windows of at most
+ * STREAMOVERLAPS overlaps, where the overlap is the longest repeat plus
+ * 2 * MAXDISTANCECONSTANT and the flanks. Consecutive windows share two
+ * overlaps, and each window reports only the repeats starting between
+ * its first and last overlap, so every repeat is found and cleaned with
+ * all of its surroundings in memory, however long the sequence. Output
+ * goes to the .dat file and, with -m, the masked file; there is no HTML. */
+static void stream_sequences(struct seqreader *reader, const char *prefix)
+{
+    FILE *destdfp, *destmfp = NULL;
+    char paramstring[_MAX_PATH], destd[_MAX_PATH], destm[_MAX_PATH];
+    struct fastasequence seq;
+    struct index_list *lpointer;
+    size_t overlap;
+    int loadstatus, newrecord, named, lo, hi, owned, printcr = 0;
+    unsigned int total = 0;
+
+    overlap = g_paramset.ps_maxwraplength + 2 * MAXDISTANCECONSTANT + g_paramset.ps_flankinglength;
+
+    if (g_paramset.ps_ngs != 1)
+        PrintProgress("Loading sequence...");
+
+    seq.sequence = NULL;
+    loadstatus = LoadSequenceWindow(reader, &seq, 2 * overlap, STREAMOVERLAPS * overlap);
+    if (loadstatus < 0) {
+        if (!reader->error)
+            PrintError("Could not load sequence. Empty file or bad format.");
+        g_paramset.ps_endstatus = "Bad format."; /* ok for now */
+        g_paramset.ps_running = 0;
+        CloseSequenceReader(reader);
+        return;
+    }
+
+    sprintf(paramstring, "%d.%d.%d.%d.%d.%d.%d",
+        g_paramset.ps_match, g_paramset.ps_mismatch, g_paramset.ps_indel,
+        g_paramset.ps_PM, g_paramset.ps_PI, g_paramset.ps_minscore, g_paramset.ps_maxperiod);
+
+    if (g_paramset.ps_ngs) {
+        destdfp = stdout;
+    }
+    else {
+        destdfp = open_dat_file(destd, prefix, paramstring);
+        if (destdfp == NULL)
+            die("Unable to open data file for writing in stream_sequences routine!");
+    }
+    print_dat_banner(destdfp);
+
+    if (g_paramset.ps_maskedfile) {
+        if (snprintf(destm, sizeof destm, "%s.%s.mask", prefix, paramstring) >= (int)sizeof destm)
+            die("Masked file name too long in stream_sequences routine!");
+        destmfp = fopen(destm, "w");
+        if (destmfp == NULL)
+            die("Unable to open masked file for writing in stream_sequences routine!");
+    }
+    open_feature_files(prefix, paramstring);
+
+    g_paramset.ps_multisequencefile = (loadstatus != 0);
+    g_paramset.ps_sequenceordinal = 1;
+    newrecord = 1;
+    named = 0;
+
+    for (;;) {
+        if (newrecord) {
+            if (g_paramset.ps_ngs != 1)
+                print_dat_sequence(destdfp, seq.name);
+            if (destmfp)
+                fprintf(destmfp, ">%s\n", seq.name);
+            named = 0;
+            printcr = 0;
+        }
+
+        g_counterInSeq = 0;
+        TRF(&seq);
+        if (g_paramset.ps_endstatus)
+            break;
+
+        /* the repeats this window reports */
+        lo = newrecord ? 0 : (int)overlap;
+        hi = loadstatus == 2 ? Length - (int)overlap : Length;
+        owned = 0;
+        for (lpointer = GlobalIndexList; lpointer != NULL; lpointer = lpointer->il_next)
+            if (lpointer->il_first > lo && lpointer->il_first <= hi)
+                owned++;
+
+        if (g_paramset.ps_ngs && owned > 0 && !named) {
+            print_dat_sequence(destdfp, seq.name);
+            named = 1;
+        }
+        print_dat_records(destdfp, GlobalIndexList, lo, hi);
+        print_feature_records(GlobalIndexList, lo, hi, seq.name);
+        total += owned;
+
+        if (destmfp) {
+            print_masked_window(destmfp, GlobalIndexList, lo, hi, &printcr);
+            if (loadstatus != 2) {
+                fputc('\n', destmfp);
+                fputc('\n', destmfp);
+            }
+        }
+
+        FreeList(GlobalIndexList);
+        GlobalIndexList = NULL;
+        GlobalIndexListTail = NULL;
+
+        newrecord = (loadstatus != 2);
+        if (newrecord) {
+            free(seq.sequence);
+            seq.sequence = NULL;
+            if (loadstatus == 0)
+                break;
+            g_paramset.ps_sequenceordinal++;
+        }
+
+        if (g_paramset.ps_ngs != 1)
+            PrintProgress("Loading sequence file...");
+
+        loadstatus = LoadSequenceWindow(reader, &seq, 2 * overlap, STREAMOVERLAPS * overlap);
+        if (loadstatus < 0) {
+            g_paramset.ps_endstatus = "Bad format.";
+            break;
+        }
+    }
+
+    free(seq.sequence);
+    CloseSequenceReader(reader);
+    if (destmfp)
+        fclose(destmfp);
+    close_feature_files();
+    finish_dat_file();
+    if (!g_paramset.ps_ngs)
+        fclose(destdfp);
+
+    g_paramset.ps_outputcount = total;
+    g_paramset.ps_running = 0;
+}
 
 /* This routine can act on a multiple-sequence file
  * and calls TRF() routine as many times as it needs to. */
 void TRFControlRoutine(void)
 {
-    FILE *srcfp, *outmfp, *destmfp, *destdfp = NULL;
-    char source[_MAX_PATH], input[_MAX_PATH], outm[_MAX_PATH],
+    FILE *srcfp, *destmfp = NULL, *destdfp = NULL;
+    struct seqreader *reader;
+    char source[_MAX_PATH], input[_MAX_PATH],
         prefix[_MAX_PATH], destm[_MAX_PATH], destd[_MAX_PATH],
-        desth[_MAX_PATH], paramstring[_MAX_PATH], outh[_MAX_PATH];
-    int a, i, loadstatus, foundsome = 0;
-    unsigned int tr_count = 0;
+        desth[_MAX_PATH], destz[_MAX_PATH], paramstring[_MAX_PATH], outh[_MAX_PATH];
+    int i, loadstatus, foundsome = 0;
     char line[1000];
     FILE *desthfp;
     struct fastasequence seq;
@@ -60,16 +519,37 @@ void TRFControlRoutine(void)
         }
     }
 
+    reader = OpenSequenceReader(srcfp);
+    if (reader == NULL)
+        die("Unable to allocate input buffer in TRFControlRoutine routine!");
+
+    /* read only the requested regions, through the .fai index */
+    if (g_paramset.ps_regioncount > 0) {
+        snprintf(line, sizeof line, "%s.fai", source);
+        if (SetSequenceRegions(reader, line, g_paramset.ps_regions, g_paramset.ps_regioncount) < 0) {
+            g_paramset.ps_endstatus = "Bad region.";
+            g_paramset.ps_running = 0;
+            CloseSequenceReader(reader);
+            return;
+        }
+    }
+
+    if (g_paramset.ps_stream) {
+        stream_sequences(reader, prefix);
+        return;
+    }
+
     /* get the first sequence */
     if (g_paramset.ps_ngs != 1)
         PrintProgress("Loading sequence...");
 
-    loadstatus = LoadSequenceFromFileEugene(&seq, srcfp);
+    loadstatus = LoadSequence(reader, &seq);
     if (loadstatus < 0) {
-        PrintError("Could not load sequence. Empty file or bad format.");
+        if (!reader->error)
+            PrintError("Could not load sequence. Empty file or bad format.");
         g_paramset.ps_endstatus = "Bad format."; /* ok for now */
         g_paramset.ps_running = 0;
-        fclose(srcfp);
+        CloseSequenceReader(reader);
         return;
     }
 
@@ -82,6 +562,14 @@ void TRFControlRoutine(void)
         g_paramset.ps_match, g_paramset.ps_mismatch, g_paramset.ps_indel,
         g_paramset.ps_PM, g_paramset.ps_PI, g_paramset.ps_minscore, g_paramset.ps_maxperiod);
 
+    /* with -zip the HTML pages of every sequence go into one archive */
+    if (g_paramset.ps_htmlzip && !g_paramset.ps_HTMLoff) {
+        if (snprintf(destz, sizeof destz, "%s.%s.html.zip", prefix, paramstring) >= (int)sizeof destz)
+            die("HTML archive name too long in TRFControlRoutine routine!");
+        if (OpenHTMLZip(destz) < 0)
+            die("Unable to open HTML archive for writing in TRFControlRoutine routine!");
+    }
+
     /* based on number of sequences in file use different approach */
     if (loadstatus == 0) {      /* only one sequence in file */
         sprintf(hsequence, "Sequence: %s\n", seq.name);
@@ -105,84 +593,44 @@ void TRFControlRoutine(void)
                 destdfp = stdout;
             }
             else {
-                sprintf(destd, "%s.%s.dat", prefix, paramstring);
-                destdfp = fopen(destd, "w");
+                destdfp = open_dat_file(destd, prefix, paramstring);
                 if (destdfp == NULL)
                     die("Unable to open data file for writing in TRFControlRoutine routine!");
             }
 
             {
-                struct index_list *lpointer;
-                int charcount;
-
-                if (g_paramset.ps_ngs != 1) {
-                    fprintf(destdfp, "Tandem Repeats Finder Program written by:\n\n");
-                    fprintf(destdfp, "Gary Benson\n");
-                    fprintf(destdfp, "Program in Bioinformatics\n");
-                    fprintf(destdfp, "Boston University\n");
-                    fprintf(destdfp, "Version %s\n", versionstring);
-                }
+                print_dat_banner(destdfp);
 
                 if (g_paramset.ps_ngs) {
                     /* only print if we have at least 1 record */
                     if (NULL != GlobalIndexList) {
-                        fprintf(destdfp, "@%s\n", seq.name);
+                        print_dat_sequence(destdfp, seq.name);
                     }
 
                 }
                 else {
-                    fprintf(destdfp, "\n\nSequence: %s\n\n\n\nParameters: %d %d %d %d %d %d %d\n\n\n",
-                        seq.name, g_paramset.ps_match, g_paramset.ps_mismatch, g_paramset.ps_indel, g_paramset.ps_PM, g_paramset.ps_PI,
-                        g_paramset.ps_minscore, g_paramset.ps_maxperiod);
+                    print_dat_sequence(destdfp, seq.name);
                 }
 
-                for (lpointer = GlobalIndexList; lpointer != NULL; lpointer = lpointer->il_next) {
-                    fprintf(destdfp, "%d %d %d %.1f %d %d %d %d %d %d %d %d %.2f %s ",
-                        lpointer->il_first, lpointer->il_last, lpointer->il_period,
-                        lpointer->il_copies, lpointer->il_size, lpointer->il_matches,
-                        lpointer->il_indels, lpointer->il_score, lpointer->il_acount,
-                        lpointer->il_ccount, lpointer->il_gcount, lpointer->il_tcount, lpointer->il_entropy, lpointer->il_pattern);
-                    for (charcount = lpointer->il_first; charcount <= lpointer->il_last; charcount++)
-                        fprintf(destdfp, "%c", Sequence[charcount]);
-
-                    /* print short flanks to .dat file */
-                    if (g_paramset.ps_ngs) {
-                        int flankstart, flankend;
-
-                        flankstart = lpointer->il_first - 50;
-                        flankstart = max(1, flankstart);
-                        flankend = lpointer->il_last + 50;
-                        flankend = min(Length, flankend);
-
-                        fprintf(destdfp, " ");
-                        if (lpointer->il_first == 1) {
-                            fprintf(destdfp, ".");
-                        }
-                        else {
-                            for (charcount = flankstart; charcount < lpointer->il_first; charcount++)
-                                fprintf(destdfp, "%c", Sequence[charcount]);
-                        }
-
-                        fprintf(destdfp, " ");
-                        if (lpointer->il_last == Length)
-                            fprintf(destdfp, ".");
-                        else
-                            for (charcount = lpointer->il_last + 1; charcount <= flankend; charcount++)
-                                fprintf(destdfp, "%c", Sequence[charcount]);
-                    }
-
-                    fprintf(destdfp, "\n");
-                    ++tr_count;
-                }
+                print_dat_records(destdfp, GlobalIndexList, 0, Length);
+                finish_dat_file();
             }
         }
 
-        /* masked file moved here so Sequence is not "ruined" by Ns for .dat output */
-        {
+        open_feature_files(prefix, paramstring);
+        print_feature_records(GlobalIndexList, 0, Length, seq.name);
+        close_feature_files();
+
+        if (g_paramset.ps_maskedfile) {
             char maskstring[_MAX_PATH];
 
             sprintf(maskstring, "%s.%s.mask", g_paramset.ps_outputprefix, paramstring);
-            MakeMaskedFile(GlobalIndexList, g_paramset.ps_maskedfile, Sequence, maskstring);
+            destmfp = fopen(maskstring, "w");
+            if (destmfp == NULL)
+                die("Unable to open masked file for writing in TRFControlRoutine routine!");
+            print_masked_sequence(destmfp, GlobalIndexList, seq.name);
+            fclose(destmfp);
+            destmfp = NULL;
         }
 
         FreeList(GlobalIndexList);
@@ -190,13 +638,15 @@ void TRFControlRoutine(void)
         GlobalIndexListTail = NULL;
 
         free(seq.sequence);
-        fclose(srcfp);
+        CloseSequenceReader(reader);
 
         if (destdfp) {
             fclose(destdfp);
             destdfp = NULL;
         }
 
+        close_html_zip();
+
         g_paramset.ps_endstatus = NULL;
         g_paramset.ps_running = 0;
         // return CTRL_SUCCESS;
@@ -218,27 +668,29 @@ void TRFControlRoutine(void)
     /* open sumary table file */
     sprintf(desth, "%s.%s.summary.html", prefix, paramstring);
     if (!g_paramset.ps_HTMLoff) {
-        desthfp = fopen(desth, "w");
+        desthfp = OpenHTMLPage(desth);
         if (desthfp == NULL)
             die("Unable to open summary file for writing in TRFControlRoutine routine!");
     }
 
     /* open masked file if requested */
     if (g_paramset.ps_maskedfile) {
-        sprintf(destm, "%s.%s.mask", prefix, paramstring);
+        if (snprintf(destm, sizeof destm, "%s.%s.mask", prefix, paramstring) >= (int)sizeof destm)
+            die("Masked file name too long in TRFControlRoutine routine!");
         destmfp = fopen(destm, "w");
         if (destmfp == NULL)
             die("Unable to open masked file for writing in TRFControlRoutine routine!");
     }
 
+    open_feature_files(prefix, paramstring);
+
     /* open datafile if requested */
     if (g_paramset.ps_datafile) {
         if (g_paramset.ps_ngs) {
             destdfp = stdout;
         }
         else {
-            sprintf(destd, "%s.%s.dat", prefix, paramstring);
-            destdfp = fopen(destd, "w");
+            destdfp = open_dat_file(destd, prefix, paramstring);
             if (destdfp == NULL)
                 die("Unable to open data file for writing in TRFControlRoutine routine!");
         }
@@ -295,74 +747,27 @@ void TRFControlRoutine(void)
             /* To have smaller sequences not send results */
             /* to disc to improve performance             */
             {
-                struct index_list *lpointer;
-                int charcount;
-
                 /* only for the first one write the header */
                 if (i == 1) {
-                    if (g_paramset.ps_ngs != 1) {
-                        fprintf(destdfp, "Tandem Repeats Finder Program written by:\n\n");
-                        fprintf(destdfp, "Gary Benson\n");
-                        fprintf(destdfp, "Program in Bioinformatics\n");
-                        fprintf(destdfp, "Boston University\n");
-                        fprintf(destdfp, "Version %s\n", versionstring);
-                    }
+                    print_dat_banner(destdfp);
                 }
 
                 if (g_paramset.ps_ngs) {
                     /* only print if we have at least 1 record */
                     if (NULL != GlobalIndexList) {
-                        fprintf(destdfp, "@%s\n", seq.name);
+                        print_dat_sequence(destdfp, seq.name);
                     }
                 }
                 else {
-                    fprintf(destdfp, "\n\nSequence: %s\n\n\n\nParameters: %d %d %d %d %d %d %d\n\n\n",
-                        seq.name, g_paramset.ps_match, g_paramset.ps_mismatch, g_paramset.ps_indel, g_paramset.ps_PM, g_paramset.ps_PI,
-                        g_paramset.ps_minscore, g_paramset.ps_maxperiod);
+                    print_dat_sequence(destdfp, seq.name);
                 }
 
-                for (lpointer = GlobalIndexList; lpointer != NULL; lpointer = lpointer->il_next) {
-                    fprintf(destdfp, "%d %d %d %.1f %d %d %d %d %d %d %d %d %.2f %s ",
-                        lpointer->il_first, lpointer->il_last, lpointer->il_period,
-                        lpointer->il_copies, lpointer->il_size, lpointer->il_matches,
-                        lpointer->il_indels, lpointer->il_score, lpointer->il_acount,
-                        lpointer->il_ccount, lpointer->il_gcount, lpointer->il_tcount, lpointer->il_entropy, lpointer->il_pattern);
-                    for (charcount = lpointer->il_first; charcount <= lpointer->il_last; charcount++)
-                        fprintf(destdfp, "%c", Sequence[charcount]);
-
-                    /* print short flanks to .dat file */
-                    if (g_paramset.ps_ngs) {
-                        int flankstart, flankend;
-
-                        flankstart = lpointer->il_first - 50;
-                        flankstart = max(1, flankstart);
-                        flankend = lpointer->il_last + 50;
-                        flankend = min(Length, flankend);
-
-                        fprintf(destdfp, " ");
-                        if (lpointer->il_first == 1) {
-                            fprintf(destdfp, ".");
-                        }
-                        else {
-                            for (charcount = flankstart; charcount < lpointer->il_first; charcount++)
-                                fprintf(destdfp, "%c", Sequence[charcount]);
-                        }
-
-                        fprintf(destdfp, " ");
-                        if (lpointer->il_last == Length) {
-                            fprintf(destdfp, ".");
-                        }
-                        else {
-                            for (charcount = lpointer->il_last + 1; charcount <= flankend; charcount++)
-                                fprintf(destdfp, "%c", Sequence[charcount]);
-                        }
-                    }
-
-                    fprintf(destdfp, "\n");
-                }
+                print_dat_records(destdfp, GlobalIndexList, 0, Length);
             }
         }
 
+        print_feature_records(GlobalIndexList, 0, Length, seq.name);
+
         if (!g_paramset.ps_HTMLoff) {
             /* print table rows based on repeat count */
             sprintf(outh, "%s.%s.1.html", input, paramstring);
@@ -372,7 +777,10 @@ void TRFControlRoutine(void)
                     "<TD><CENTER><A TARGET=\"%s\" HREF=\"%s\">%s</A>"
                     "</CENTER></TD><TD><CENTER>%d</CENTER></TD></TR>", i, outh, outh, seq.name, g_paramset.ps_outputcount);
                 foundsome = 1;
+                CommitHTMLPages();
             }
+            else if (g_paramset.ps_htmlzip)
+                DiscardHTMLPages();
             else {
                 /* remove html files if no output in it */
                 remove(outh);
@@ -381,33 +789,9 @@ void TRFControlRoutine(void)
             }
         }
 
-        /* masked file moved here so Sequence is not "ruined" by Ns for .dat output */
-        {
-            char maskstring[_MAX_PATH];
-
-            sprintf(maskstring, "%s.s%d.%s.mask", prefix, i, paramstring);
-            MakeMaskedFile(GlobalIndexList, g_paramset.ps_maskedfile, Sequence, maskstring);
-        }
-
-        /* append new output to destination files */
-        if (g_paramset.ps_maskedfile) {
-            /* recreate the name of the masked sequence file */
-            sprintf(outm, "%s.s%d.%s.mask", prefix, i, paramstring);
-            outmfp = fopen(outm, "r");
-            if (outmfp == NULL)
-                die("Unable to open masked file for reading in TRFControlRoutine routine!");
-            /* copy until end of file */
-            while (1) {
-                a = getc(outmfp);
-                if (a == EOF)
-                    break;
-                putc(a, destmfp);
-            }
-            fclose(outmfp);
-
-            /* remove intermediary file */
-            remove(outm);
-        }
+        /* append the masked sequence to the masked file */
+        if (g_paramset.ps_maskedfile)
+            print_masked_sequence(destmfp, GlobalIndexList, seq.name);
 
         FreeList(GlobalIndexList);
         GlobalIndexList = NULL;
@@ -421,7 +805,11 @@ void TRFControlRoutine(void)
             if (g_paramset.ps_ngs != 1)
                 PrintProgress("Loading sequence file...");
 
-            loadstatus = LoadSequenceFromFileEugene(&seq, srcfp);
+            loadstatus = LoadSequence(reader, &seq);
+            if (loadstatus < 0) {
+                g_paramset.ps_endstatus = "Bad format.";
+                break;
+            }
             g_paramset.ps_sequenceordinal++;
             i++;
         }
@@ -440,20 +828,24 @@ void TRFControlRoutine(void)
     }
 
     /* close files */
-    fclose(srcfp);
+    CloseSequenceReader(reader);
     if (g_paramset.ps_maskedfile)
         fclose(destmfp);
 
-    if (g_paramset.ps_datafile)
+    if (g_paramset.ps_datafile) {
+        finish_dat_file();
         fclose(destdfp);
+    }
+
+    close_feature_files();
 
     if (!g_paramset.ps_HTMLoff)
-        fclose(desthfp);
+        CloseHTMLPage(desthfp);
+    close_html_zip();
 
     /* set output file name to the summary table */
     strcpy(g_paramset.ps_outputfilename, desth);
 
-    g_paramset.ps_endstatus = NULL;
     g_paramset.ps_running = 0;
     return;
 }
@@ -559,9 +951,7 @@ void TRF(struct fastasequence *pseq)
 
     /* start txt file */
     if (!g_paramset.ps_HTMLoff) {
-        Fptxt = fopen(txtstring, "w");
-        if (Fptxt == NULL)
-            die("Unable to open alignment file for writing in TRF() routine!");
+        StartAlignmentText();
 
         fprintf(Fptxt, "<HTML>");
         fprintf(Fptxt, "<HEAD>");
@@ -609,6 +999,7 @@ void TRF(struct fastasequence *pseq)
     /* set the sequence pointer. more global vars! */
     Sequence = pseq->sequence - 1;  /* start one character before */
     Length = pseq->length;
+    Sequenceoffset = pseq->offset;
 
     if (!g_paramset.ps_HTMLoff) {
         fprintf(Fptxt, "\n\nLength: %d", Length);
@@ -668,13 +1059,8 @@ void TRF(struct fastasequence *pseq)
             Wasted_total += (Criteria_count[i] + Consensus_count[i]) * i * (2 * d_range(i) + 1) * 2;
     }
 
-    if (!g_paramset.ps_HTMLoff) {
-        fprintf(Fptxt, "Done.\n");
-        fprintf(Fptxt, "</PRE>");
-        fprintf(Fptxt, "</BODY>");
-        fprintf(Fptxt, "</HTML>");
-        fclose(Fptxt);
-    }
+    if (!g_paramset.ps_HTMLoff)
+        EndAlignmentText();
 
     /****************************************************************
      * The following memory deallocations where not originally
@@ -693,10 +1079,6 @@ void TRF(struct fastasequence *pseq)
     free(Consensus_count);
     free(Cell_count);
     free(Outputsize_count);
-    free(AlignPair.textprime);
-    free(AlignPair.textsecnd);
-    free(AlignPair.indexprime);
-    free(AlignPair.indexsecnd);
     free(Tag);
     free(Index);
     free_distanceseenarray();
@@ -704,9 +1086,11 @@ void TRF(struct fastasequence *pseq)
     /* free distance list and all its entries */
     distanceentry_free();
     free(Distance);
+    free(Alignplan);
 
     for (i = 1; i <= NTS; i++) {
         free(Tuplehash[i]);
+        free(Tuplehashtable[i]);
         free(History[i]);
     }
 
@@ -715,7 +1099,13 @@ void TRF(struct fastasequence *pseq)
     if (g_paramset.ps_ngs != 1)
         PrintProgress("Resolving output...");
 
-    TRFClean(datstring, txtstring, MaxPeriod);
+    TRFClean(txtstring, htmlstring, MaxPeriod);
+
+    /* TRFClean rebuilds the surviving alignments in AlignPair */
+    free(AlignPair.textprime);
+    free(AlignPair.textsecnd);
+    free(AlignPair.indexprime);
+    free(AlignPair.indexsecnd);
 
     /* Set the name of the outputfilename global to name given to
      * file in routines defined in trfclean.h */
@@ -777,96 +1167,3 @@ void SetProgressBar(void)
         putchar('.');
 }
 
-
-/*
- *   loads a sequence from an open file. If the routine comes to another
- *   sequence header while reading a sequence the sequence returns 1 to
- *   indicate that more sequences are present. Otherwise the routine returns
- *   0 to indicate EOF or -1 to indicate error.
- *   The member sequence must be NULL before the routine is called.
- *   The calling function must free the allocated memory after use.
- */
-int LoadSequenceFromFileEugene(struct fastasequence *pseq, FILE *fp)
-{
-    int i, j, c;
-    int next = -1;              // whether a next sequence was encountered
-    char *ptemp;
-    char to_upper;
-
-    // read the FASTA '>' symbol
-    c = getc(fp);
-    if ((char)c != '>' || c == EOF)
-        return -1;              // invalid format
-
-    // read name and description text
-    for (i = 0; i < MAXSEQNAMELEN - 1; i++) {
-        c = getc(fp);
-        if (c == 10 || c == 13) {
-            break;
-        }
-        else if (c == EOF) {
-            PrintError("FASTA input terminated too early");
-            return -1;
-        }
-        else {
-            pseq->name[i] = (char)c;
-        }
-    }
-    pseq->name[i] = '\0';
-
-    // if line was not read completely flush the rest
-    if (i == MAXSEQNAMELEN - 1) {
-        c = 0;
-        while (c != 13 && c != 10 && c != EOF)
-            c = getc(fp);
-    }
-
-    // read sequence into buffer
-    pseq->sequence = NULL;
-    for (i = 0; i < 26; i++)
-        pseq->composition[i] = 0;
-    to_upper = 'A' - 'a';
-
-    i = 0;
-    for (j = 0; c != EOF && (char)c != '>'; j += MEMBLOCK) {
-        if ((ptemp = realloc(pseq->sequence, sizeof(char) * (i + MEMBLOCK + 1))) == NULL) {
-            PrintError("Insufficient memory");
-            return -1;
-        }
-        pseq->sequence = ptemp;
-        for (i = j; i < j + MEMBLOCK;) {
-            c = getc(fp);       // get a character from file
-            if ((char)c >= 'A' && (char)c <= 'Z') { // in upper-case range of alpha characters
-                pseq->sequence[i] = (char)c;
-                pseq->composition[c - (int)'A']++;
-                i++;
-            }
-            else if ((char)c >= 'a' && (char)c <= 'z') {    // in lower-case range of alpha characters
-                pseq->sequence[i] = (char)c + to_upper; // make upper-case
-                pseq->composition[c - (int)'a']++;
-                i++;
-            }
-            else if ((char)c == '>') {  // break if another sequence found
-                next = 1;
-                ungetc('>', fp);
-                break;
-            }
-            else if (c == EOF) {    // break if end of file
-                next = 0;
-                break;
-            }
-        }
-    }
-    pseq->length = i;           // set sequence length
-    if (i > 0) {
-        pseq->sequence[i] = '\0';   // terminate sequence text as a string
-    }
-
-    // compute member
-    pseq->nucleotides =
-        pseq->composition['A' - 'A'] + pseq->composition['C' - 'A'] +
-        pseq->composition['G' - 'A'] + pseq->composition['T' - 'A'];
-
-    return next;
-}
-
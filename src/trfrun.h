@@ -39,11 +39,10 @@ void FreeList(struct index_list * headptr);
 #define _MAX_PATH 260
 #endif
 
-// how much memory to allocate at first when loading a sequence
-// (added by Eugene Scherba, 2010-02-16)
-#define MEMBLOCK (10*1024*1024)
+/* length of a -stream window, in overlaps of the longest repeat
+ * plus 2 * MAXDISTANCECONSTANT and the flanks */
+#define STREAMOVERLAPS 16
 
-int LoadSequenceFromFileEugene(struct fastasequence * pseq, FILE * fp);    /* may use stdin and better file reading for handling large files over 2GB */
 int LoadSequenceFromFileBenson(struct fastasequence * pseq, FILE * fp);    /* old function, uses filepos, 32bit version of this would not process a file over 2GB properly */
 void TRFControlRoutine(void);
 void TRF(struct fastasequence * pseq);
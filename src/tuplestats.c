@@ -0,0 +1,536 @@
+/*
+Tandem Repeats Finder
+Copyright (C) 1999-2020 Gary Benson
+
+This file is part of the Tandem Repeats Finder (TRF) program.
+
+TRF is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+TRF is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public
+License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "tuplestats.h"
+
+/* percentiles used for the two criteria */
+#define TS_SUMPERCENTILE  0.95
+#define TS_WAITPERCENTILE 0.99
+
+/* bump if the way the tables are computed changes */
+#define TS_CACHEVERSION 1
+
+#define TS_MAXPATH 1024
+
+/* samples per distance when simulating spaced seeds */
+#define TS_SEEDSAMPLES 10000
+
+/* a spaced seed is written as 0s and 1s, oldest position first, and must
+ * begin and end with 1. Returns the mask, or 0 if str is not a seed. */
+static int ParseSeedMask(const char *str, const char **end)
+{
+    const char *p;
+    int mask = 0, zeros = 0;
+
+    for (p = str; *p == '0' || *p == '1'; p++) {
+        mask = mask * 2 + (*p - '0');
+        zeros += (*p == '0');
+        if (p - str >= TS_MAXTUPLESIZE)
+            return 0;
+    }
+
+    if (zeros == 0 || *str != '1' || p[-1] != '1')
+        return 0;
+
+    *end = p;
+    return mask;
+}
+
+int SeedWeight(int mask)
+{
+    int weight = 0;
+
+    for (; mask != 0; mask >>= 1)
+        weight += mask & 1;
+
+    return weight;
+}
+
+int ParseTupleSchedule(const char *spec, int *sizes, int *masks, int *starts, int maxentries)
+{
+    int n = 0, mask;
+    const char *p = spec;
+    const char *seedend;
+    char *end;
+    long size, start;
+
+    while (*p != '\0') {
+        if (n == maxentries)
+            return 0;
+
+        if ((mask = ParseSeedMask(p, &seedend)) != 0) {
+            size = seedend - p;
+            end = (char *)seedend;
+        }
+        else
+            size = strtol(p, &end, 10);
+        if (end == p || *end != ':')
+            return 0;
+
+        p = end + 1;
+        start = strtol(p, &end, 10);
+        if (end == p || (*end != ',' && *end != '\0'))
+            return 0;
+
+        if (size < TS_MINTUPLESIZE || size > TS_MAXTUPLESIZE || start < 1 || start > TS_MAXDISTANCE)
+            return 0;
+        if (mask != 0 && SeedWeight(mask) < TS_MINTUPLESIZE)
+            return 0;
+
+        /* spans and starting distances must both increase */
+        if (n == 0 && start != 1)
+            return 0;
+        if (n > 0 && (size <= sizes[n - 1] || start <= starts[n - 1]))
+            return 0;
+
+        sizes[n] = size;
+        masks[n] = mask;
+        starts[n] = start;
+        n++;
+
+        p = (*end == ',') ? end + 1 : end;
+    }
+
+    return n;
+}
+
+/* Distribution of the number of heads in runs of at least k heads in
+ * n tosses, for every n in 0..N. Returns a triangular table where
+ * tails[TailIndex(n, c)] = P(sum >= c), c in 0..n+1. If inrun is set
+ * the tosses continue a run that already has k heads. */
+static size_t TailIndex(int n, int c)
+{
+    return (size_t)n * (n + 3) / 2 + c;
+}
+
+static double *RunSumTails(double p, int k, int N, int inrun)
+{
+    double q = 1.0 - p;
+    int width = N + 2;
+    double *tails, *cur, *next, *swap;
+    double acc, s;
+    int n, r, c;
+
+    tails = malloc(TailIndex(N + 1, 0) * sizeof(double));
+    cur = calloc((size_t)(k + 1) * width, sizeof(double));
+    next = calloc((size_t)(k + 1) * width, sizeof(double));
+    if (tails == NULL || cur == NULL || next == NULL) {
+        free(tails);
+        free(cur);
+        free(next);
+        return NULL;
+    }
+
+    /* cur[r * width + c]: current run length r (k means k or more),
+     * c heads counted so far */
+    cur[(inrun ? k : 0) * width] = 1.0;
+
+    for (n = 0;; n++) {
+        acc = 0.0;
+        for (c = n + 1; c >= 0; c--) {
+            for (r = 0; r <= k; r++)
+                acc += cur[r * width + c];
+            tails[TailIndex(n, c)] = acc;
+        }
+
+        if (n == N)
+            break;
+
+        memset(next, 0, (size_t)(k + 1) * width * sizeof(double));
+        for (c = 0; c <= n; c++) {
+            s = 0.0;
+            for (r = 0; r <= k; r++)
+                s += cur[r * width + c];
+            next[c] += s * q;
+
+            for (r = 0; r < k - 1; r++)
+                next[(r + 1) * width + c] += cur[r * width + c] * p;
+
+            /* completing a run counts all of its k heads */
+            if (c + k < width)
+                next[k * width + c + k] += cur[(k - 1) * width + c] * p;
+            next[k * width + c + 1] += cur[k * width + c] * p;
+        }
+
+        swap = cur;
+        cur = next;
+        next = swap;
+    }
+
+    free(cur);
+    free(next);
+    return tails;
+}
+
+/* first[t] = probability that the first run of k heads ends at toss t */
+static double *FirstRunTimes(double p, int k, int N)
+{
+    double q = 1.0 - p;
+    double *first, *run, tot;
+    int t, r;
+
+    first = calloc(N + 1, sizeof(double));
+    run = calloc(k, sizeof(double));
+    if (first == NULL || run == NULL) {
+        free(first);
+        free(run);
+        return NULL;
+    }
+
+    run[0] = 1.0;
+    for (t = 1; t <= N; t++) {
+        tot = 0.0;
+        for (r = 0; r < k; r++)
+            tot += run[r];
+
+        first[t] = run[k - 1] * p;
+        for (r = k - 1; r > 0; r--)
+            run[r] = run[r - 1] * p;
+        run[0] = tot * q;
+    }
+
+    free(run);
+    return first;
+}
+
+/* Spaced seeds have too many states for the exact computation, so the
+ * criteria are estimated by simulation as the original tables were.
+ * Each sample is one sequence of N tosses; its prefixes serve as the
+ * samples for every shorter length. Matches are counted as in
+ * add_tuple_match_to_Distance_entry: a seed hit adds its weight, a hit
+ * right after another adds one. */
+static unsigned long long TupleStatsRandom(unsigned long long *state)
+{
+    /* xorshift64*, so that cached tables do not depend on the C library */
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static int SimulateSeedStats(double p, int span, int mask, int lo, int hi,
+    int *waitdata, int *sumdata)
+{
+    unsigned long long state, threshold;
+    unsigned short *sums;
+    int *first, *count;
+    int weight = SeedWeight(mask);
+    int full = (1 << span) - 1;
+    int N = (hi < TS_MINWINDOW) ? TS_MINWINDOW : hi;
+    int sample, t, window, hit, prevhit, sum, d, n, c, total, need, acc;
+
+    /* hits that overlap without being adjacent count their positions
+     * again, so the sum may exceed the number of tosses */
+    int maxsum = weight * N + 1;
+
+    sums = malloc((size_t)TS_SEEDSAMPLES * (N + 1) * sizeof *sums);
+    first = malloc(TS_SEEDSAMPLES * sizeof *first);
+    count = malloc((maxsum + 1) * sizeof *count);
+    if (sums == NULL || first == NULL || count == NULL) {
+        free(sums);
+        free(first);
+        free(count);
+        return -1;
+    }
+
+    state = 0x9E3779B97F4A7C15ULL ^ ((unsigned long long)mask << 32) ^ (unsigned long long)(p * 1000);
+    threshold = (unsigned long long)(p * 9007199254740992.0);     /* p * 2^53 */
+
+    for (sample = 0; sample < TS_SEEDSAMPLES; sample++) {
+        window = 0;
+        prevhit = 0;
+        sum = 0;
+        first[sample] = 0;
+        sums[(size_t)sample * (N + 1)] = 0;
+        for (t = 1; t <= N; t++) {
+            window = ((window << 1) | ((TupleStatsRandom(&state) >> 11) < threshold)) & full;
+            hit = (t >= span && (window & mask) == mask);
+            if (hit) {
+                sum += prevhit ? 1 : weight;
+                if (first[sample] == 0)
+                    first[sample] = t;
+            }
+            prevhit = hit;
+            sums[(size_t)sample * (N + 1) + t] = sum;
+        }
+    }
+
+    for (d = lo; d <= hi; d++) {
+        n = (d < TS_MINWINDOW) ? TS_MINWINDOW : d;
+
+        /* k-run sums criterion */
+        memset(count, 0, (maxsum + 1) * sizeof *count);
+        for (sample = 0; sample < TS_SEEDSAMPLES; sample++)
+            count[sums[(size_t)sample * (N + 1) + n]]++;
+
+        need = (int)(TS_SUMPERCENTILE * TS_SEEDSAMPLES + 0.5);
+        for (c = weight * n, acc = 0; c > 0; c--)
+            if ((acc += count[c]) >= need)
+                break;
+        sumdata[d] = c;
+
+        /* waiting time criterion, among samples meeting the sum criterion */
+        memset(count, 0, (maxsum + 1) * sizeof *count);
+        total = 0;
+        for (sample = 0; sample < TS_SEEDSAMPLES; sample++)
+            if (sums[(size_t)sample * (N + 1) + n] >= c) {
+                count[(first[sample] == 0 || first[sample] > n) ? n + 1 : first[sample]]++;
+                total++;
+            }
+
+        need = (int)(TS_WAITPERCENTILE * total + 0.5);
+        for (t = 1, acc = 0; t <= n; t++)
+            if ((acc += count[t]) >= need)
+                break;
+        waitdata[d] = (t <= n) ? t : n;
+    }
+
+    free(sums);
+    free(first);
+    free(count);
+    return 0;
+}
+
+static int GenerateTupleStats(int PM, int ntuples, const int *sizes, const int *masks,
+    const int *starts, int *waitdata, int *sumdata)
+{
+    double p = (double)PM / 100;
+    double *tails, *inrun, *first, tot, cum, g;
+    int i, k, lo, hi, N, d, n, c, t, need;
+
+    for (i = 0; i < ntuples; i++) {
+        k = sizes[i];
+        lo = starts[i];
+        hi = (i + 1 < ntuples) ? starts[i + 1] - 1 : TS_MAXDISTANCE;
+        N = (hi < TS_MINWINDOW) ? TS_MINWINDOW : hi;
+
+        if (masks != NULL && masks[i] != 0) {
+            if (SimulateSeedStats(p, k, masks[i], lo, hi, waitdata, sumdata) != 0)
+                return -1;
+            continue;
+        }
+
+        tails = RunSumTails(p, k, N, 0);
+        inrun = RunSumTails(p, k, N, 1);
+        first = FirstRunTimes(p, k, N);
+        if (tails == NULL || inrun == NULL || first == NULL) {
+            free(tails);
+            free(inrun);
+            free(first);
+            return -1;
+        }
+
+        for (d = lo; d <= hi; d++) {
+            n = (d < TS_MINWINDOW) ? TS_MINWINDOW : d;
+
+            /* k-run sums criterion */
+            for (c = n; c > 0; c--)
+                if (tails[TailIndex(n, c)] >= TS_SUMPERCENTILE)
+                    break;
+            sumdata[d] = c;
+
+            /* waiting time criterion, given the sum criterion is met.
+             * After the first run ends at t the remaining heads needed
+             * come from n - t tosses continuing that run. */
+            tot = tails[TailIndex(n, c)];
+            cum = 0.0;
+            waitdata[d] = n;
+            for (t = k; t <= n; t++) {
+                need = c - k;
+                if (need <= 0)
+                    g = 1.0;
+                else if (need <= n - t)
+                    g = inrun[TailIndex(n - t, need)];
+                else
+                    g = 0.0;
+
+                cum += first[t] * g;
+                if (cum >= TS_WAITPERCENTILE * tot) {
+                    waitdata[d] = t;
+                    break;
+                }
+            }
+        }
+
+        free(tails);
+        free(inrun);
+        free(first);
+    }
+
+    waitdata[0] = sumdata[0] = 0;
+    return 0;
+}
+
+int FitTupleSchedule(int PM, int ntuples, const int *sizes, int *starts)
+{
+    double p = (double)PM / 100;
+    double *tails;
+    int i, d, n;
+
+    if (ntuples < 1)
+        return 0;
+
+    starts[0] = 1;
+    for (i = 1; i < ntuples; i++) {
+        if ((tails = RunSumTails(p, sizes[i], TS_MAXDISTANCE, 0)) == NULL)
+            return 0;
+
+        /* the criterion is at least k+1 where P(sum >= k+1) >= 95% */
+        for (d = starts[i - 1] + 1; d <= TS_MAXDISTANCE; d++) {
+            n = (d < TS_MINWINDOW) ? TS_MINWINDOW : d;
+            if (tails[TailIndex(n, sizes[i] + 1)] >= TS_SUMPERCENTILE)
+                break;
+        }
+
+        free(tails);
+        if (d > TS_MAXDISTANCE)
+            break;
+
+        starts[i] = d;
+    }
+
+    return i;
+}
+
+/* Builds the cache file name, creating the cache directory if needed.
+ * Returns 0 if no cache can be used. */
+static int TupleStatsCacheName(char *path, size_t pathsize, char *header, size_t headersize,
+    int PM, int ntuples, const int *sizes, const int *masks, const int *starts)
+{
+    char schedule[512], dir[TS_MAXPATH];
+    const char *env;
+    size_t len = 0;
+    int i, b;
+
+    schedule[0] = '\0';
+    for (i = 0; i < ntuples; i++) {
+        if (i > 0)
+            len += snprintf(schedule + len, sizeof schedule - len, "-");
+
+        /* seeds are written as s followed by the mask */
+        if (masks != NULL && masks[i] != 0) {
+            len += snprintf(schedule + len, sizeof schedule - len, "s");
+            for (b = sizes[i] - 1; b >= 0; b--)
+                len += snprintf(schedule + len, sizeof schedule - len, "%d", (masks[i] >> b) & 1);
+        }
+        else
+            len += snprintf(schedule + len, sizeof schedule - len, "%d", sizes[i]);
+
+        len += snprintf(schedule + len, sizeof schedule - len, ".%d", starts[i]);
+    }
+
+    if ((env = getenv("TRF_CACHE_DIR")) != NULL && *env != '\0')
+        snprintf(dir, sizeof dir, "%s", env);
+    else if ((env = getenv("HOME")) != NULL && *env != '\0')
+        snprintf(dir, sizeof dir, "%s/.trf", env);
+    else
+        return 0;
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+        return 0;
+
+    if ((size_t)snprintf(path, pathsize, "%s/tuplestats-PM%d-%s.txt", dir, PM, schedule) >= pathsize)
+        return 0;
+
+    snprintf(header, headersize, "# TRF tuple statistics %d PM=%d schedule=%s\n", TS_CACHEVERSION, PM, schedule);
+    return 1;
+}
+
+static int LoadTupleStats(const char *path, const char *header, int *waitdata, int *sumdata)
+{
+    FILE *fp;
+    char line[256];
+    int d, n, wait, sum, ok = 1;
+
+    if ((fp = fopen(path, "r")) == NULL)
+        return -1;
+
+    if (fgets(line, sizeof line, fp) == NULL || strcmp(line, header) != 0)
+        ok = 0;
+
+    for (d = 1; ok && d <= TS_MAXDISTANCE; d++) {
+        if (fscanf(fp, "%d %d %d", &n, &wait, &sum) != 3 || n != d || wait < 0 || sum < 0)
+            ok = 0;
+        else {
+            waitdata[d] = wait;
+            sumdata[d] = sum;
+        }
+    }
+
+    fclose(fp);
+    if (!ok)
+        return -1;
+
+    waitdata[0] = sumdata[0] = 0;
+    return 0;
+}
+
+/* The file is written under a temporary name and then renamed, so
+ * concurrent runs never see a partial table. Failing to save is not
+ * an error, the table is simply generated again next time. */
+static void SaveTupleStats(const char *path, const char *header, const int *waitdata, const int *sumdata)
+{
+    char tmppath[TS_MAXPATH + 32];
+    FILE *fp;
+    int d, ok;
+
+    snprintf(tmppath, sizeof tmppath, "%s.%ld.tmp", path, (long)getpid());
+    if ((fp = fopen(tmppath, "w")) == NULL)
+        return;
+
+    ok = fputs(header, fp) >= 0;
+    for (d = 1; ok && d <= TS_MAXDISTANCE; d++)
+        ok = fprintf(fp, "%d %d %d\n", d, waitdata[d], sumdata[d]) > 0;
+
+    if (fclose(fp) != 0)
+        ok = 0;
+
+    if (!ok || rename(tmppath, path) != 0)
+        remove(tmppath);
+}
+
+int GetTupleStats(int PM, int ntuples, const int *sizes, const int *masks, const int *starts,
+    int *waitdata, int *sumdata)
+{
+    char path[TS_MAXPATH], header[512];
+    int cached;
+
+    if (PM < TS_MINPM || PM > TS_MAXPM || ntuples < 1)
+        return -1;
+
+    cached = TupleStatsCacheName(path, sizeof path, header, sizeof header, PM, ntuples, sizes, masks, starts);
+    if (cached && LoadTupleStats(path, header, waitdata, sumdata) == 0)
+        return 0;
+
+    if (GenerateTupleStats(PM, ntuples, sizes, masks, starts, waitdata, sumdata) != 0)
+        return -1;
+
+    if (cached)
+        SaveTupleStats(path, header, waitdata, sumdata);
+
+    return 0;
+}
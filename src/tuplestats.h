@@ -0,0 +1,87 @@
+#ifndef TRF_TUPLESTATS_H
+#define TRF_TUPLESTATS_H
+
+/*
+Tandem Repeats Finder
+Copyright (C) 1999-2020 Gary Benson
+
+This file is part of the Tandem Repeats Finder (TRF) program.
+
+TRF is free software: you can redistribute it and/or modify
+it under the terms of the GNU Affero General Public License as
+published by the Free Software Foundation, either version 3 of
+the License, or (at your option) any later version.
+
+TRF is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See
+the GNU Affero General Public License for more details.
+
+You should have received a copy of the GNU Affero General Public
+License along with TRF.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/****************************************************************
+ *
+ *   TUPLESTATS.H : Waiting time and k-run sums criteria
+ *
+ *****************************************************************
+ *   The tuple filter in newtupbo() accepts a candidate distance d
+ *   only if the matching tuples in the last d characters meet two
+ *   criteria, both derived from a coin toss model of a tandem repeat
+ *   with match probability PM:
+ *
+ *   i.   k-run sums: the number of heads falling in runs of at least
+ *        k heads must be at least the value met by 95% of sequences.
+ *   ii.  waiting time: the first run of k heads must end no later
+ *        than the position met by 99% of the sequences that pass i.
+ *
+ *   Both are computed exactly by dynamic programming over the run
+ *   length and head count, for the tuple size k in effect at each
+ *   distance.  Spaced seeds are estimated by simulation instead.  The published tables for PM=80 and PM=75 (see
+ *   init_and_fill_coin_toss_stats2000_with_4tuplesizes) were produced
+ *   by simulation of the same model and agree with it up to the
+ *   sampling noise of that simulation.
+ *
+ *   Generated tables are cached in $TRF_CACHE_DIR (or $HOME/.trf)
+ *   so that later runs with the same parameters can load them.
+ *****************************************************************/
+
+/* tables cover distances 1..TS_MAXDISTANCE, as the built-in ones */
+#define TS_MAXDISTANCE 2000
+
+/* smaller windows are padded to this length, see g_Min_Distance_Window */
+#define TS_MINWINDOW 20
+
+#define TS_MINPM 51
+#define TS_MAXPM 99
+
+/* TS_MAXTUPLESIZE must not exceed MAXTUPLESIZE in tr30dat.h */
+#define TS_MINTUPLESIZE 2
+#define TS_MAXTUPLESIZE 12
+
+/* Parses a schedule such as "4:1,5:30,7:160", giving the tuple size to
+ * use from each starting distance on. A size may instead be a spaced
+ * seed such as 11011011, where 0 marks a position that is not compared;
+ * its span is then stored in sizes and its mask in masks (0 for plain
+ * tuples), with bit 0 the newest position. Returns the number of
+ * entries, or 0 if the schedule is malformed. */
+int ParseTupleSchedule(const char *spec, int *sizes, int *masks, int *starts, int maxentries);
+
+/* number of compared positions of a spaced seed mask */
+int SeedWeight(int mask);
+
+/* Sets the starting distance of each tuple size after the first so that
+ * the smallest pattern using size k has a k-run sums criterion of at
+ * least k+1. Sizes that never reach it are dropped. Returns the number
+ * of entries kept, or 0 on failure. */
+int FitTupleSchedule(int PM, int ntuples, const int *sizes, int *starts);
+
+/* Fills waitdata[1..TS_MAXDISTANCE] and sumdata[1..TS_MAXDISTANCE] for
+ * the given PM and schedule, from the cache if possible. masks may be
+ * NULL if the schedule has no spaced seeds. Returns 0 on
+ * success and -1 on failure. */
+int GetTupleStats(int PM, int ntuples, const int *sizes, const int *masks, const int *starts,
+    int *waitdata, int *sumdata);
+
+#endif